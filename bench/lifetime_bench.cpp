@@ -0,0 +1,96 @@
+// Bimodal-lifetime churn: most blocks die within a round, a few live for many rounds.
+// Compares resident memory after release_free_pages() with and without Lifetime hints.
+
+#include "block_allocator.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include <unistd.h>
+
+using mem::BlockAllocator;
+using mem::Lifetime;
+
+namespace {
+
+constexpr std::size_t kBlockSize   = 256;
+constexpr std::size_t kBlockCount  = 64 * 1024; // 16 MiB pool
+constexpr std::size_t kRounds      = 200;
+constexpr std::size_t kPerRound    = 8 * 1024;
+constexpr std::size_t kLongPercent = 5;
+constexpr std::size_t kLongRounds  = 50; // long-lived blocks survive this many rounds
+
+std::size_t resident_bytes() {
+  std::ifstream statm( "/proc/self/statm" );
+  std::size_t   size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * static_cast< std::size_t >( ::sysconf( _SC_PAGESIZE ) );
+}
+
+struct Result {
+  std::size_t released;
+  std::size_t rss_before;
+  std::size_t rss_after;
+  double      seconds;
+};
+
+Result run( bool hinted ) {
+  BlockAllocator                      alloc( kBlockSize, kBlockCount, 64 );
+  std::mt19937                        rng( 42 );
+  std::deque< std::vector< void * > > generations;
+  std::vector< void * >               short_lived;
+  const auto                          start = std::chrono::steady_clock::now();
+
+  for ( std::size_t round = 0; round < kRounds; ++round ) {
+    std::vector< void * > long_lived;
+    for ( std::size_t i = 0; i < kPerRound; ++i ) {
+      const bool is_long = rng() % 100 < kLongPercent;
+      void *     p       = hinted ? alloc.allocate( is_long ? Lifetime::Long : Lifetime::Short ) : alloc.allocate();
+      std::memset( p, 0xab, kBlockSize );
+      ( is_long ? long_lived : short_lived ).push_back( p );
+    }
+    for ( void * p : short_lived )
+      alloc.deallocate( p );
+    short_lived.clear();
+
+    generations.push_back( std::move( long_lived ) );
+    if ( generations.size() > kLongRounds ) {
+      for ( void * p : generations.front() )
+        alloc.deallocate( p );
+      generations.pop_front();
+    }
+  }
+
+  Result result{};
+  result.rss_before = resident_bytes();
+  result.released   = alloc.release_free_pages();
+  result.rss_after  = resident_bytes();
+  result.seconds    = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+
+  for ( const auto & generation : generations )
+    for ( void * p : generation )
+      alloc.deallocate( p );
+  return result;
+}
+
+void print( const char * name, const Result & r ) {
+  std::printf( "%-10s released %8.2f MiB  rss %8.2f -> %8.2f MiB  (%.3f s)\n", name,
+               static_cast< double >( r.released ) / ( 1024.0 * 1024.0 ),
+               static_cast< double >( r.rss_before ) / ( 1024.0 * 1024.0 ),
+               static_cast< double >( r.rss_after ) / ( 1024.0 * 1024.0 ), r.seconds );
+}
+
+} // namespace
+
+int main() {
+  std::printf( "%zu rounds x %zu blocks of %zu bytes, %zu%% live for %zu rounds\n", kRounds, kPerRound, kBlockSize,
+               kLongPercent, kLongRounds );
+  print( "unhinted", run( false ) );
+  print( "hinted", run( true ) );
+  return 0;
+}
@@ -0,0 +1,81 @@
+// Append, sequential scan and random indexing: SegmentedVector vs std::deque and std::vector.
+// std::vector is given no reserve(), so its appends include reallocation and copying.
+
+#include "segmented_vector.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t kElements = 8 * 1024 * 1024;
+constexpr std::size_t kLookups  = 8 * 1024 * 1024;
+
+struct Item {
+  std::uint64_t key;
+  std::uint64_t value;
+};
+
+struct Result {
+  double        append;
+  double        scan;
+  double        random;
+  double        clear;
+  std::uint64_t checksum;
+};
+
+double seconds_since( std::chrono::steady_clock::time_point start ) {
+  return std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+}
+
+template < class Seq > Result run( Seq & seq ) {
+  Result result{};
+  auto   start = std::chrono::steady_clock::now();
+  for ( std::size_t i = 0; i < kElements; ++i )
+    seq.push_back( Item{ i, i * 3 } );
+  result.append = seconds_since( start );
+
+  start = std::chrono::steady_clock::now();
+  for ( std::size_t i = 0; i < seq.size(); ++i )
+    result.checksum += seq[i].value;
+  result.scan = seconds_since( start );
+
+  std::mt19937_64 rng( 7 );
+  start = std::chrono::steady_clock::now();
+  for ( std::size_t i = 0; i < kLookups; ++i )
+    result.checksum += seq[rng() % kElements].key;
+  result.random = seconds_since( start );
+
+  start = std::chrono::steady_clock::now();
+  seq.clear();
+  result.clear = seconds_since( start );
+  return result;
+}
+
+void print( const char * name, const Result & r ) {
+  std::printf( "%-16s append %7.1f ms  scan %7.1f ms  random %7.1f ms  clear %6.2f ms  (checksum %llu)\n", name,
+               r.append * 1e3, r.scan * 1e3, r.random * 1e3, r.clear * 1e3, static_cast< unsigned long long >( r.checksum ) );
+}
+
+} // namespace
+
+int main() {
+  std::printf( "%zu elements of %zu bytes, %zu random lookups\n", kElements, sizeof( Item ), kLookups );
+  {
+    mem::SegmentedVector< Item > seq( kElements );
+    print( "SegmentedVector", run( seq ) );
+  }
+  {
+    std::deque< Item > seq;
+    print( "std::deque", run( seq ) );
+  }
+  {
+    std::vector< Item > seq;
+    print( "std::vector", run( seq ) );
+  }
+  return 0;
+}
@@ -1,8 +1,19 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -23,13 +34,119 @@
  * No license. See README.md for details.
  */
 namespace mem {
+class BlockAllocator;
+class MemoryBudget;
+class PagePool;
+
+/**
+ * @brief Called when a pool cannot satisfy an allocation (see BlockAllocator::add_exhaustion_handler()).
+ *
+ * Runs without the pool lock, so it may free blocks of @p pool, drain deferred frees or evict
+ * cache entries. @p blocks is how many free blocks the failing call needs.
+ *
+ * @return true if it may have made room (the allocation is retried), false if it had nothing to give.
+ */
+using ExhaustionHandler = std::function< bool( BlockAllocator & pool, std::size_t blocks ) >;
+
+/// What ~BlockAllocator() does about blocks that are still allocated.
+enum class LeakPolicy {
+  Ignore,      ///< Unmap silently.
+  Report,      ///< Print the leaked block count, indices and sampled call sites to stderr.
+  AbortInDebug ///< Report, then abort() unless NDEBUG is defined.
+};
+
+/**
+ * @brief Optional construction-time settings for BlockAllocator.
+ */
+struct BlockAllocatorOptions {
+  /**
+   * Number of blocks to reserve address space for (0 = just block_count). When larger than
+   * block_count, the region is reserved with mmap(PROT_NONE, MAP_NORESERVE) and further pages
+   * are committed with mprotect as the pool runs dry, so it grows in place up to this limit.
+   */
+  std::size_t reserve_blocks = 0;
+
+  /// Destructor behaviour for outstanding blocks; see also BlockAllocator::set_leak_policy().
+  LeakPolicy leak_policy = LeakPolicy::Ignore;
+
+  /**
+   * Shared slab pool for rebalancing memory between pools (nullptr = none). Growth adopts
+   * donated slabs before committing new pages, and donate_free_slabs() hands the pool's free
+   * tail to it. The PagePool must outlive the allocator.
+   */
+  PagePool * page_pool = nullptr;
+
+  /**
+   * Budget charged for every committed page (nullptr = none). Construction fails with
+   * std::bad_alloc if the initial pages do not fit, and growth stops at the hard limit. The
+   * pool registers decommit_free_tail() as a reclaim callback. The budget must outlive the
+   * allocator.
+   */
+  MemoryBudget * budget = nullptr;
+
+  /**
+   * Passes over the exhaustion handlers an allocation makes before it fails. Bounds the work
+   * when handlers keep reporting progress that other threads consume first.
+   */
+  std::size_t exhaustion_retries = 3;
+};
+
+/// Expected lifetime of a block, used to keep short- and long-lived blocks on separate pages.
+enum class Lifetime {
+  Default, ///< No preference; same as Short.
+  Short,   ///< Freed soon (per-request data).
+  Long     ///< Kept for a long time (caches, sessions).
+};
+
+/// Small label attached to a block for bulk release (see BlockAllocator::deallocate_all()).
+enum class BlockTag : std::uint16_t {
+  None = 0 ///< Untagged; any other value is caller-defined, e.g. `BlockTag{ session_id }`.
+};
+
+/// Call stack shared by sampled blocks that are still allocated (see BlockAllocator::sampled_sites()).
+struct SampledSite {
+  std::vector< void * > frames;           ///< Return addresses, innermost first.
+  std::size_t           sampled_blocks;   ///< Live sampled blocks allocated from this stack.
+  std::size_t           estimated_blocks; ///< sampled_blocks scaled by the sampling interval.
+};
+
+/// How BlockAllocator::snapshot() keeps the copy point-in-time.
+enum class SnapshotMethod {
+  Auto,         ///< WriteProtect when userfaultfd is available, Pause otherwise.
+  WriteProtect, ///< userfaultfd write-protection; writers only stall while their page is copied.
+  Pause         ///< Copy the region under the pool lock, then write the file.
+};
+
+/// Outcome of BlockAllocator::snapshot().
+struct SnapshotStats {
+  std::size_t    bytes_written;      ///< File size.
+  std::size_t    pages_copied_early; ///< Pages copied ahead of the stream because a writer touched them.
+  SnapshotMethod method;             ///< WriteProtect or Pause.
+};
+
+/// How BlockAllocator::restore() brings block contents back.
+enum class RestoreMode {
+  Eager, ///< Read the whole file before returning.
+  Lazy   ///< Return at once; fill pages from the file on first touch (userfaultfd) and in the background.
+};
+
+/// Age of one allocated block, in epoch ticks (see BlockAllocator::oldest_blocks()).
+struct BlockAge {
+  std::size_t   index; ///< Block index.
+  std::uint16_t age;   ///< Ticks since allocation (modulo 2^16).
+};
+
 /**
  * @class BlockAllocator
  * @brief Simple fixed-size block allocator with alignment and thread-safety.
  *
  * Blocks are carved from a single pre-allocated, aligned region. Allocation and
- * deallocation are O(1) (pop/push from a singly-linked free-list). The allocator
- * is thread-safe via a single internal mutex.
+ * deallocation are O(1) (pop/push from a singly-linked free-list, falling back to a bump
+ * cursor over never-used blocks). The allocator is thread-safe via a single internal mutex.
+ *
+ * The region is one mmap'd range for the allocator's lifetime. A growable pool reserves
+ * address space for max_block_count() blocks up front and commits pages on demand, so the
+ * pointer range check and index math stay a single subtraction and division.
  *
  * @note All methods are safe to call from multiple threads concurrently.
  */
@@ -40,11 +157,14 @@ public:
    * @param block_size The requested size (in bytes) for each block (payload).
    * @param block_count Number of blocks to reserve in the pool.
    * @param alignment Desired alignment (power of two, >= alignof(void*)). Every block start will satisfy this.
+   * @param options Optional settings, see BlockAllocatorOptions.
    *
    * @throw std::invalid_argument if parameters are invalid, sizes overflow, or alignment is not a power of two / too small.
    * @throw std::bad_alloc if the underlying memory region cannot be allocated.
+   * @throw std::runtime_error if the region lies outside the address range PageMap covers.
    */
-  BlockAllocator( std::size_t block_size, std::size_t block_count, std::size_t alignment );
+  BlockAllocator( std::size_t block_size, std::size_t block_count, std::size_t alignment,
+                  const BlockAllocatorOptions & options = BlockAllocatorOptions{} );
 
   /// Non-copyable / non-movable by design.
   BlockAllocator( const BlockAllocator & )             = delete;
@@ -52,16 +172,69 @@ public:
   BlockAllocator( BlockAllocator && )                  = delete;
   BlockAllocator & operator=( BlockAllocator && )      = delete;
 
-  /// Destructor frees the underlying region.
+  /// Destructor drains deferred frees, applies the leak policy, and unmaps the underlying region.
   ~BlockAllocator() noexcept;
 
   /**
-   * @brief Allocate one block.
+   * @brief Allocate one block, growing a growable pool if it is exhausted.
    * @return Pointer to a block of size() bytes, aligned to alignment().
    * @throw std::bad_alloc if no blocks are available.
    */
   void * allocate();
 
+  /**
+   * @brief Allocate one block, placing it according to its expected lifetime.
+   *
+   * Long-lived blocks are carved from their own page-group sized runs (about 64 KiB) and
+   * recycled through a separate free list, so short-lived churn leaves whole pages free for
+   * release_free_pages(). Short/Default behave like allocate(). Either side falls back to the
+   * other before the pool reports exhaustion. Ignored in deterministic mode.
+   *
+   * @param hint Expected lifetime of the block.
+   * @return Pointer to a block of size() bytes, aligned to alignment().
+   * @throw std::bad_alloc if no blocks are available.
+   */
+  void * allocate( Lifetime hint );
+
+  /**
+   * @brief Allocate one block labelled with @p tag, for release together with its peers by deallocate_all().
+   *
+   * Tags are kept out of band in a 16-bit array (2 bytes per reservable block, allocated on the
+   * first tagged allocation), so block contents are untouched. Freeing a block by any means
+   * clears its tag.
+   *
+   * @param tag Label; BlockTag::None allocates an untagged block.
+   * @return Pointer to a block of size() bytes, aligned to alignment().
+   * @throw std::bad_alloc if no blocks are available.
+   */
+  void * allocate( BlockTag tag );
+
+  /**
+   * @brief Allocate one block whose first block_size() bytes are zero.
+   *
+   * Prefers blocks known to be zero — never-used blocks of the fresh mapping and blocks whose
+   * pages were released by release_free_pages() — and only clears recycled blocks. Large
+   * clears use non-temporal stores where available.
+   *
+   * @return Pointer to a zero-filled block of size() bytes, aligned to alignment().
+   * @throw std::bad_alloc if no blocks are available.
+   */
+  void * allocate_zeroed();
+
+  /**
+   * @brief Allocate one block on behalf of a logical stream.
+   *
+   * In deterministic mode (see set_deterministic_streams()) the block comes from the
+   * sub-range owned by `key % deterministic_streams()`, lowest address first, so the
+   * addresses a stream observes depend only on its own allocate/deallocate sequence and
+   * not on how other threads interleave. Otherwise this behaves exactly like allocate().
+   *
+   * @param key Caller-chosen stream identifier.
+   * @return Pointer to a block of size() bytes, aligned to alignment().
+   * @throw std::bad_alloc if the stream's sub-range has no free blocks.
+   */
+  void * allocate_stream( std::uint64_t key );
+
   /**
    * @brief Return a previously allocated block to the pool.
    * @param p Pointer previously obtained from allocate() of this allocator. nullptr is ignored.
@@ -69,11 +242,138 @@ public:
    */
   void deallocate( void * p );
 
+  /**
+   * @brief Queue a block for deferred return without touching the pool lock.
+   *
+   * The pointer is range-checked and pushed onto a lock-free buffer owned by the calling
+   * thread; drain() or the background reclaimer returns queued blocks in address-ordered
+   * batches. When the caller's buffer is full it is flushed synchronously (back-pressure).
+   * Double frees are only detected when the block is drained.
+   *
+   * @param p Pointer previously obtained from this allocator. nullptr is ignored.
+   * @throw std::runtime_error if @p p does not belong to this allocator or is misaligned.
+   */
+  void deallocate_async( void * p );
+
+  /**
+   * @brief Return every block queued by deallocate_async() to the pool.
+   * @return Number of blocks returned.
+   * @throw std::runtime_error if a queued block was already free; all valid blocks are still returned.
+   */
+  std::size_t drain();
+
+  /**
+   * @brief Start a background thread that calls drain() every @p interval.
+   * @throw std::logic_error if the reclaimer is already running.
+   */
+  void start_reclaimer( std::chrono::milliseconds interval );
+
+  /// Stop the background reclaimer (if running); it performs one last drain() on the way out.
+  void stop_reclaimer() noexcept;
+
+  /// @return Number of blocks queued by deallocate_async() and not yet drained (not counted by free_blocks()).
+  std::size_t pending_frees() const noexcept { return pending_frees_.load( std::memory_order_relaxed ); }
+
+  /**
+   * @brief Return many blocks at once.
+   *
+   * Range and stride checks run over the whole batch in a vectorisable pass outside the lock;
+   * the pointers are then radix-sorted by block index, checked for double frees, and spliced
+   * onto the free list in address order under a single lock acquisition, so later allocations
+   * stream through memory sequentially. The batch is validated as a whole: if any pointer is
+   * invalid, nothing is freed. nullptr entries are ignored.
+   *
+   * @param ptrs Array of @p n pointers obtained from this allocator.
+   * @param n Number of pointers.
+   * @throw std::invalid_argument if @p ptrs is nullptr while @p n > 0.
+   * @throw std::runtime_error if any pointer does not belong to this allocator, is misaligned,
+   *        is not allocated, or appears twice in the batch.
+   */
+  void deallocate_batch( void * const * ptrs, std::size_t n );
+
+  /**
+   * @brief Free a chain of blocks linked through their own first bytes, under one lock and without allocating.
+   *
+   * Each block's first pointer-sized bytes hold the next block of the chain (nullptr ends it),
+   * which an owner can write once a block's contents are dead, so destructors can return many
+   * blocks without building an array. As with deallocate_batch(), the chain is validated as a
+   * whole: if any block is invalid, nothing is freed. Blocks go onto the free list in chain order.
+   *
+   * @param head First block of the chain; nullptr is ignored.
+   * @throw std::runtime_error if any block does not belong to this allocator, is misaligned,
+   *        is not allocated, or appears twice in the chain (a cycle included).
+   */
+  void deallocate_chain( void * head );
+
+  /**
+   * @brief Free every allocated block labelled @p tag, replacing per-owner pointer lists.
+   *
+   * Scans the tag array eight entries per SSE2 compare and returns all matches under one lock
+   * acquisition, like deallocate_batch().
+   *
+   * Blocks queued by deallocate_async() but not drained yet are skipped: the drain frees them.
+   *
+   * @return Number of blocks freed (always 0 for BlockTag::None).
+   */
+  std::size_t deallocate_all( BlockTag tag );
+
+  /// @return Tag of block @p idx (BlockTag::None if it is free, untagged or out of range).
+  BlockTag tag_of( std::size_t idx ) const noexcept;
+
+  /**
+   * @brief Allocate @p k blocks as a single transaction: either all of them or none.
+   *
+   * All blocks are taken under one lock acquisition, so other threads never observe a
+   * partially satisfied request.
+   *
+   * @param out Array receiving @p k block pointers. Left untouched on failure.
+   * @param k Number of blocks requested. k == 0 trivially succeeds.
+   * @param available Optional; receives the number of free blocks seen by the attempt.
+   * @return true if all @p k blocks were reserved, false if fewer were available.
+   * @throw std::invalid_argument if @p out is nullptr while @p k > 0.
+   */
+  bool allocate_all( void ** out, std::size_t k, std::size_t * available = nullptr );
+
+  /**
+   * @brief Like allocate_all(), but waits up to @p timeout for @p k blocks to become free.
+   *
+   * Waiters are only woken once the pool holds enough free blocks for the smallest pending
+   * request. Requests larger than max_block_count() fail immediately.
+   *
+   * @param out Array receiving @p k block pointers. Left untouched on failure.
+   * @param k Number of blocks requested.
+   * @param timeout Maximum time to wait.
+   * @param available Optional; receives the number of free blocks seen by the last attempt.
+   * @return true if all @p k blocks were reserved before the timeout expired.
+   * @throw std::invalid_argument if @p out is nullptr while @p k > 0.
+   */
+  bool allocate_all_for( void ** out, std::size_t k, std::chrono::nanoseconds timeout, std::size_t * available = nullptr );
+
+  /**
+   * @brief Register a handler to run, in registration order, when an allocation finds no free block.
+   *
+   * Covers every allocate*() variant. When the pool is empty and cannot grow, the pool lock is
+   * released and the handlers run one pass at a time; after each pass the allocation is retried.
+   * It fails as before once a pass reports no progress or BlockAllocatorOptions::exhaustion_retries
+   * passes have run. Threads that run dry together wait for the running pass instead of starting
+   * their own, and an allocation made from inside a handler does not re-enter the chain.
+   *
+   * @return Id for remove_exhaustion_handler() (never 0).
+   * @note Handlers must not add or remove handlers of the same pool.
+   */
+  std::size_t add_exhaustion_handler( ExhaustionHandler handler );
+
+  /// Unregister a handler; waits for a pass that is running it to finish.
+  void remove_exhaustion_handler( std::size_t id );
+
   /// @return Requested payload size in bytes (before internal rounding).
   std::size_t block_size() const noexcept { return block_size_; }
 
-  /// @return Number of blocks in the pool.
-  std::size_t block_count() const noexcept { return block_count_; }
+  /// @return Number of blocks currently committed in the pool.
+  std::size_t block_count() const noexcept;
+
+  /// @return Number of blocks the pool may grow to (equals the initial block count unless reserve_blocks was set).
+  std::size_t max_block_count() const noexcept { return max_blocks_; }
 
   /// @return Alignment (in bytes) guaranteed for each block.
   std::size_t alignment() const noexcept { return alignment_; }
@@ -81,34 +381,365 @@ public:
   /// @return Actual stride in bytes (internal rounded block size).
   std::size_t stride() const noexcept { return stride_; }
 
-  /// @return Total capacity of the region in bytes.
-  std::size_t capacity_bytes() const noexcept { return stride_ * block_count_; }
+  /// @return Total capacity of the committed blocks in bytes.
+  std::size_t capacity_bytes() const noexcept;
 
   /// @return Number of currently free blocks.
   std::size_t free_blocks() const noexcept;
 
+  /// @return Number of allocated blocks, counted with a word-wise popcount over the occupancy bitmap.
+  std::size_t allocated_blocks() const noexcept;
+
+  /// @return Indices of up to @p max_count allocated blocks, lowest first.
+  std::vector< std::size_t > allocated_indices( std::size_t max_count = static_cast< std::size_t >( -1 ) ) const;
+
+  /// Change what the destructor does about outstanding blocks.
+  void set_leak_policy( LeakPolicy policy ) noexcept;
+
+  /// Write a leak report (count, indices, sampled call sites) to @p os. Writes nothing if no block is allocated.
+  void report_leaks( std::ostream & os ) const;
+
+  /// Number of buckets returned by age_histogram().
+  static constexpr std::size_t kAgeBuckets = 17;
+
+  /**
+   * @brief Turn per-block allocation timestamps on or off.
+   *
+   * Each allocation records the current 16-bit epoch in an out-of-band array (2 bytes per
+   * block). Blocks already allocated when tracking starts are stamped with the current epoch.
+   * The epoch only moves when advance_epoch() is called, e.g. from a periodic timer, so the
+   * tick length is the caller's choice. Ages wrap after 65536 ticks.
+   */
+  void set_age_tracking( bool enabled );
+
+  /// Advance the allocation epoch by one tick. Lock-free.
+  void advance_epoch() noexcept { epoch_.fetch_add( 1, std::memory_order_relaxed ); }
+
+  /// @return Current allocation epoch.
+  std::uint16_t current_epoch() const noexcept { return epoch_.load( std::memory_order_relaxed ); }
+
+  /**
+   * @brief Histogram of allocated block ages on a log2 scale.
+   * @return Bucket 0 counts age 0; bucket k (k >= 1) counts ages in [2^(k-1), 2^k). All zero when tracking is off.
+   */
+  std::array< std::size_t, kAgeBuckets > age_histogram() const;
+
+  /// @return Up to @p n allocated blocks with the largest age, oldest first (empty when tracking is off).
+  std::vector< BlockAge > oldest_blocks( std::size_t n ) const;
+
+  /**
+   * @brief Sample every @p interval-th allocation's call stack (0 disables sampling).
+   *
+   * Sampled stacks are captured with backtrace() outside the pool lock and kept in an
+   * out-of-band table keyed by block index until the block is freed. For a byte-based rate,
+   * pass bytes / stride(). With sampling off the only cost is one relaxed atomic load per
+   * allocation. Covers allocate() and its Lifetime and BlockTag overloads, allocate_zeroed() and
+   * allocate_stream(). Disabling drops samples already taken.
+   */
+  void set_sample_interval( std::size_t interval );
+
+  /// @return Live sampled blocks grouped by call stack, most blocks first.
+  std::vector< SampledSite > sampled_sites() const;
+
+  /// Write sampled_sites() to @p os with symbolised frames.
+  void dump_sampled_sites( std::ostream & os ) const;
+
+  /**
+   * @brief Return whole pages covered only by free blocks to the kernel (MADV_DONTNEED).
+   *
+   * Blocks lying entirely inside a released page range are taken off the free list and
+   * remembered as known-zero, so allocate_zeroed() can hand them out without clearing.
+   * Does nothing in deterministic mode or while snapshot() runs.
+   *
+   * @return Number of bytes advised away (pages released by an earlier call may be counted again).
+   */
+  std::size_t release_free_pages();
+
+  /**
+   * @brief Shrink the pool by moving whole free slabs at the end of its region to the page pool.
+   *
+   * Only the trailing run of free blocks is eligible, so no live block moves. The pages are
+   * moved with mremap( MREMAP_DONTUNMAP ) and stay resident for the adopting pool; where the
+   * kernel lacks that flag they are released to the kernel instead. The vacated range becomes
+   * reserved address space again, so this pool can still grow back up to max_block_count().
+   * Does nothing without BlockAllocatorOptions::page_pool in deterministic mode, or while snapshot() runs.
+   *
+   * @param max_slabs Most slabs to donate.
+   * @return Number of slabs taken off the pool.
+   */
+  std::size_t donate_free_slabs( std::size_t max_slabs = static_cast< std::size_t >( -1 ) );
+
+  /**
+   * @brief Decommit whole free pages at the end of the region, shrinking the pool.
+   *
+   * Like donate_free_slabs(), but the pages go back to the kernel (and their bytes back to the
+   * MemoryBudget, if any). The pool can grow back up to max_block_count(). Does nothing in
+   * deterministic mode or while snapshot() runs.
+   *
+   * @param max_bytes Most bytes to decommit.
+   * @return Number of bytes decommitted.
+   */
+  std::size_t decommit_free_tail( std::size_t max_bytes = static_cast< std::size_t >( -1 ) );
+
+  /**
+   * @brief Map a block pointer to its stable index in [0, block_count()).
+   * @throw std::runtime_error if @p p is not a block start of this allocator.
+   */
+  std::size_t index_of( const void * p ) const;
+
+  /// @return Start of block @p idx. No bounds check; @p idx must be < block_count().
+  void * block_at( std::size_t idx ) const noexcept { return region_ + idx * stride_; }
+
+  /// @return true if block @p idx is currently allocated (false for out-of-range indices).
+  bool is_allocated( std::size_t idx ) const noexcept;
+
+  /**
+   * @brief Visit every allocated block in address order.
+   *
+   * Walks the occupancy bitmap a word at a time, so free stretches are skipped cheaply.
+   * The pool lock is held for the duration; @p f must not call back into this allocator.
+   *
+   * @param f Callable invoked as `f( std::size_t index, void * block )`.
+   */
+  template < class F > void for_each_allocated( F && f ) const {
+    std::lock_guard< std::mutex > lock( mtx_ );
+    for ( std::size_t w = 0; w < occupancy_.size(); ++w ) {
+      for ( std::uint64_t bits = occupancy_[w]; bits != 0; bits &= bits - 1 ) {
+        const std::size_t idx = w * 64 + static_cast< std::size_t >( __builtin_ctzll( bits ) );
+        f( idx, block_at( idx ) );
+      }
+    }
+  }
+
+  /**
+   * @brief Enable or disable deterministic (replayable) allocation order.
+   *
+   * With @p streams > 0 the pool is split into @p streams contiguous sub-ranges, each with
+   * its own address-ordered free list; blocks always return to the sub-range they came from.
+   * Plain allocate() and allocate_all() draw from stream 0. Calling it again rewinds every
+   * sub-range to address order, which is the starting point for a replay. Passing 0 restores
+   * the shared free list.
+   *
+   * @param streams Number of sub-ranges, or 0 to disable.
+   * @throw std::logic_error if any block is currently allocated.
+   * @throw std::invalid_argument if @p streams exceeds block_count().
+   */
+  void set_deterministic_streams( std::size_t streams );
+
+  /// @return Number of deterministic streams, 0 when the mode is off.
+  std::size_t deterministic_streams() const noexcept;
+
+  /**
+   * @brief Write a point-in-time copy of the pool (geometry, occupancy, block contents) to @p path.
+   *
+   * With userfaultfd the committed region is write-protected (UFFDIO_WRITEPROTECT) under a
+   * brief lock and then streamed to the file page by page on the calling thread while the
+   * pool stays in use; a thread that writes a page not yet streamed stalls until a handler
+   * thread has copied that page aside. The Pause fallback copies the region while holding
+   * the pool lock, which stops pool operations but not writes into blocks already handed
+   * out, so quiesce those writers for a consistent image. Page releases, donation and
+   * decommit are skipped while a snapshot runs.
+   *
+   * The call returns once the file is complete; to stream in the background, run it on a
+   * thread of your own (e.g. std::async). Other threads keep using the pool meanwhile.
+   *
+   * @param path File to create or replace. Contents go to a temporary file in the same
+   *        directory that is renamed to @p path on success, so a failed or rejected snapshot
+   *        leaves an existing @p path untouched.
+   * @param method See SnapshotMethod.
+   * @return What was written and how.
+   * @throw std::logic_error if another snapshot of this pool is running.
+   * @throw std::runtime_error if the file cannot be written, or WriteProtect was requested but is unavailable.
+   */
+  SnapshotStats snapshot( const std::string & path, SnapshotMethod method = SnapshotMethod::Auto );
+
+  /**
+   * @brief Create a pool from a snapshot() file.
+   *
+   * The new pool has the snapshot's geometry; allocated blocks keep their indices and
+   * contents, and free blocks are handed out lowest address first.
+   *
+   * In Lazy mode only the header and occupancy are read up front. The region is registered
+   * with userfaultfd (missing-page mode): a handler thread fills a page from the file the
+   * first time any thread touches it, while a prefetcher thread fills the rest in address
+   * order, so the pool is usable in time independent of its size. Free blocks are not
+   * threaded onto a list (which would touch their pages); they read as zero, and pages
+   * holding only free blocks are never read from the file. Page releases, donation and
+   * decommit are skipped until restore_pages_pending() reaches 0. Falls back to Eager when
+   * userfaultfd is unavailable; if the kernel refuses to fill a page part way through, the
+   * remaining pages are copied in eagerly by the prefetcher and the range is unregistered.
+   *
+   * @param path File written by snapshot().
+   * @param options Settings for the new pool; reserve_blocks is raised to the snapshot's max_block_count().
+   * @param mode See RestoreMode.
+   * @throw std::runtime_error if the file cannot be read or is not a snapshot.
+   * @throw std::bad_alloc if the pool cannot be created.
+   */
+  static std::unique_ptr< BlockAllocator > restore( const std::string & path, const BlockAllocatorOptions & options = {},
+                                                    RestoreMode mode = RestoreMode::Eager );
+
+  /// @return Pages a lazy restore() has not filled yet (0 once complete, or for pools not lazily restored).
+  std::size_t restore_pages_pending() const noexcept;
+
+  /**
+   * @brief Record that the block at @p p was modified, for incremental checkpoints.
+   *
+   * Sets the block's bit in an out-of-band dirty bitmap with one atomic OR; takes no lock, so
+   * writers may call it concurrently with each other and with collect_dirty(). Call it after
+   * the modification: a block changed again after its index was collected must be marked again.
+   *
+   * @throw std::runtime_error if @p p is not a block of this pool.
+   */
+  void mark_dirty( const void * p );
+
+  /**
+   * @brief Return and clear the set of blocks marked since the last call.
+   *
+   * Clean words are only read, never written, so the cost is one pass over max_block_count() / 64
+   * words plus the dirty bits. Indices may name blocks freed since they were marked; check
+   * is_allocated() (or write occupancy alongside) when building a checkpoint.
+   *
+   * @return Dirty block indices in ascending order.
+   */
+  std::vector< std::size_t > collect_dirty();
+
 private:
   struct FreeNode {
     FreeNode * next;
   };
 
+  struct AsyncBuffer; // per-thread SPSC queue for deallocate_async(), defined in the .cpp
+  struct LazyRestore; // userfaultfd page-in state of a lazy restore(), defined in snapshot.cpp
+
+  static constexpr std::size_t kSampleFrames = 32;
+
+  struct SampledStack {
+    std::array< void *, kSampleFrames > frames;
+    std::size_t                         depth;
+  };
+
+  struct Stream {
+    FreeNode *  head;  // address-ordered free list of this sub-range
+    std::size_t free;  // free blocks in this sub-range
+    std::size_t count; // total blocks in this sub-range
+  };
+
   std::size_t block_size_;
-  std::size_t block_count_;
+  std::size_t block_count_; // committed blocks
   std::size_t alignment_;
   std::size_t stride_;
+  std::size_t max_blocks_; // blocks covered by the address space reservation
+
+  std::byte *    region_;          // base of the pool (aligned)
+  std::byte *    map_base_;        // start of the mapping, including alignment slack
+  std::size_t    map_bytes_;       // length of the mapping
+  std::size_t    committed_bytes_; // bytes of region_ that are readable/writable
+  PagePool *     page_pool_;       // source and sink of whole slabs (may be nullptr)
+  MemoryBudget * budget_;          // charged for committed_bytes_ (may be nullptr)
+  std::size_t    budget_id_;       // our reclaim callback in budget_
+
+  FreeNode *  free_list_;      // head of embedded free-list
+  FreeNode *  long_free_list_; // free blocks carved for Lifetime::Long
+  std::size_t long_cur_;       // next uncarved block of the current long-lived run
+  std::size_t long_end_;       // end of the current long-lived run
+  std::size_t free_count_;     // number of free blocks (listed + never carved)
+  std::size_t bump_;           // blocks [bump_, block_count_) have never been handed out
+  std::size_t touched_;        // blocks at or above this index have never been written (read as zero)
 
-  std::byte * region_;     // base of the pool
-  FreeNode *  free_list_;  // head of embedded free-list
-  std::size_t free_count_; // number of free blocks
+  std::vector< std::uint64_t > long_side_;    // blocks carved for Lifetime::Long (return to long_free_list_)
+  std::vector< std::uint64_t > parked_;       // free blocks off the free list whose pages were released (zero)
+  std::size_t                  parked_count_; // number of bits set in parked_
+  std::size_t                  parked_hint_;  // no parked block lives below this word
 
-  std::vector< std::uint8_t > occupancy_; // 0 = free, 1 = allocated (guard against double-free)
+  std::vector< std::uint64_t > occupancy_; // bit per block: 0 = free, 1 = allocated (guard against double-free)
 
-  mutable std::mutex mtx_;
+  std::unique_ptr< std::atomic< std::uint64_t >[] > dirty_; // bit per reservable block, set by mark_dirty() without the lock
+
+  std::vector< Stream > streams_;     // deterministic mode: one free list per sub-range (empty otherwise)
+  std::size_t           stream_span_; // blocks per deterministic sub-range
+
+  bool                           snapshot_active_; // region pages must stay in place (no madvise/mremap) while set
+  std::shared_ptr< LazyRestore > lazy_restore_;    // set by a lazy restore() until destruction
+  std::atomic< bool >            restoring_;       // region still registered for missing-page faults
+
+  mutable std::mutex           mtx_;
+  std::condition_variable      cv_;      // signalled when enough blocks are free for a waiter
+  std::multiset< std::size_t > wait_ks_; // block counts requested by allocate_all_for() waiters
+
+  std::atomic< LeakPolicy > leak_policy_;
+
+  const std::size_t                                          exhaustion_retries_;
+  std::mutex                                                 handlers_mtx_;    // taken before mtx_, held while a pass runs
+  std::vector< std::pair< std::size_t, ExhaustionHandler > > handlers_;        // by id, in registration order
+  std::size_t                                                next_handler_id_;
+  std::atomic< bool >                                        has_handlers_;
+  std::atomic< std::thread::id >                             handling_thread_; // thread running a pass, if any
+
+  std::atomic< std::uint16_t >                      epoch_;       // coarse allocation clock for age tracking
+  std::vector< std::uint16_t >                      alloc_epoch_; // per-block allocation epoch; empty when tracking is off
+  std::vector< std::uint16_t >                      tags_;        // per-block BlockTag, None when free; empty until first tag
+  std::unique_ptr< std::atomic< std::uint64_t >[] > queued_;      // bit per block in an async buffer; made with tags_
+  std::atomic< bool >                               tagged_;      // tags_ and queued_ exist; deallocate_async() reads it unlocked
+
+  std::atomic< std::size_t >                      sample_interval_;  // 0 = sampling off
+  std::atomic< std::size_t >                      sample_countdown_; // allocations until the next sample
+  std::unordered_map< std::size_t, SampledStack > samples_;          // live sampled blocks by index
+
+  const std::uint64_t                           id_;            // process-unique, keys thread-local buffers
+  std::mutex                                    async_mtx_;     // guards async_buffers_, serialises draining
+  std::vector< std::shared_ptr< AsyncBuffer > > async_buffers_; // one per thread that used deallocate_async()
+  std::atomic< std::size_t >                    pending_frees_;
+  std::mutex                                    reclaimer_mtx_;
+  std::condition_variable                       reclaimer_cv_;
+  bool                                          reclaimer_stop_;
+  std::thread                                   reclaimer_;
 
   static constexpr bool is_power_of_two( std::size_t x ) noexcept { return x && ( ( x & ( x - 1 ) ) == 0 ); }
 
+  static constexpr std::size_t kStreamingClearBytes = 32 * 1024; // clears this large bypass the cache
+  static constexpr std::size_t kLongChunkBytes      = 64 * 1024; // carve run for long-lived blocks
+
   static std::size_t round_up( std::size_t value, std::size_t align ) noexcept;
+  static void        clear_block( void * p, std::size_t size ) noexcept;
+
+  static bool test_bit( const std::vector< std::uint64_t > & bits, std::size_t i ) noexcept {
+    return ( bits[i / 64] >> ( i % 64 ) ) & 1u;
+  }
+  static void set_bit( std::vector< std::uint64_t > & bits, std::size_t i ) noexcept {
+    bits[i / 64] |= std::uint64_t{ 1 } << ( i % 64 );
+  }
+  static void clear_bit( std::vector< std::uint64_t > & bits, std::size_t i ) noexcept {
+    bits[i / 64] &= ~( std::uint64_t{ 1 } << ( i % 64 ) );
+  }
+
+  FreeNode *  build_list_unlocked( std::size_t first, std::size_t count ) noexcept;
+  std::size_t available_unlocked( std::size_t stream ) const noexcept;
+  void *      pop_unlocked( std::size_t stream ) noexcept; // requires available_unlocked( stream ) > 0
+  void *      pop_hinted_unlocked( Lifetime hint ) noexcept;
+  bool        reserve_long_chunk_unlocked() noexcept;
+  void *      pop_zero_unlocked() noexcept; // requires a never-written bump block or a parked block
+  std::size_t carve_unlocked() noexcept;
+  std::size_t unpark_unlocked() noexcept;
+  void *      claim_unlocked( std::size_t idx ) noexcept;
+  void        push_unlocked( std::size_t idx ) noexcept;
+  bool        grow_unlocked( std::size_t need ) noexcept; // commit pages until @p need blocks are free
+  bool        grow_locked( std::unique_lock< std::mutex > & lock, std::size_t need ); // may unlock to reclaim budget
+  // Run the exhaustion handlers until @p k blocks of @p stream are free; unlocks while they run, returns locked
+  bool recover_locked( std::unique_lock< std::mutex > & lock, std::size_t stream, std::size_t k );
+  std::size_t free_tail_bytes_unlocked() const noexcept; // committed bytes past the last allocated block
+  void        adopt_slabs_unlocked( std::size_t target_bytes ) noexcept;
+  void        shrink_unlocked( std::size_t new_committed ) noexcept; // drop the free blocks past @p new_committed bytes
+  void        notify_waiters_unlocked() noexcept;
+  bool        sample_if_due( SampledStack & stack ) noexcept; // captures the caller's stack when due
+  void        record_sample_unlocked( const void * p, const SampledStack & stack ) noexcept;
+  AsyncBuffer & thread_buffer();
+  std::size_t   drain_locked( AsyncBuffer * only ); // requires async_mtx_; nullptr drains every buffer
+
+  void        rebuild_free_list_unlocked() noexcept; // after restore: every non-allocated block is listed
+  void        park_free_blocks_unlocked() noexcept;  // after lazy restore: every non-allocated block is parked
+  bool        region_pinned_unlocked() const noexcept { return snapshot_active_ || restoring_.load( std::memory_order_acquire ); }
 
+  std::size_t index_of_node( const void * node ) const noexcept;
   bool        is_from_region_unlocked( const void * p ) const noexcept;
   std::size_t index_from_ptr_unlocked( const void * p ) const; // throws std::runtime_error on invalid
 };
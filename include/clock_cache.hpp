@@ -0,0 +1,268 @@
+#pragma once
+#include "block_allocator.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+ * @file clock_cache.hpp
+ * @brief Fixed-capacity key/value cache with CLOCK eviction whose entries live in BlockAllocator blocks.
+ *
+ * Each entry (key and value together) occupies one block of a private pool sized for the
+ * cache, so inserts never call malloc. Once the pool is full, an insert evicts a victim chosen
+ * by the CLOCK (second-chance) policy and constructs the new entry in the victim's block: no
+ * allocator round trip at all. Recency is one bit per block in an out-of-band bitmap, and the
+ * hand skips whole words of recently used entries at a time. Lookups go through an
+ * open-addressing table of 32-bit block indices with linear probing and backward-shift
+ * deletion, so the index never fills with tombstones.
+ *
+ * @copyright
+ * No license. See README.md for details.
+ */
+namespace mem {
+/**
+ * @class ClockCache
+ * @brief Bounded cache approximating LRU: find() marks an entry used, eviction takes the first unused one past the hand.
+ *
+ * Pointers returned by find() and references returned by put() stay valid until the entry is
+ * erased or evicted.
+ *
+ * @tparam K Key type.
+ * @tparam V Value type.
+ * @tparam Hash Hash function for K.
+ * @tparam KeyEqual Equality for K.
+ * @note Like standard containers, a ClockCache is not safe for concurrent use; even find() updates recency.
+ */
+template < class K, class V, class Hash = std::hash< K >, class KeyEqual = std::equal_to< K > > class ClockCache final {
+public:
+  /**
+   * @brief Construct an empty cache holding up to @p capacity entries.
+   * @throw std::invalid_argument if @p capacity is 0 or does not fit a 32-bit handle.
+   * @throw std::bad_alloc if the pool cannot be allocated.
+   */
+  explicit ClockCache( std::size_t capacity )
+      : pool_{ sizeof( Entry ), check_capacity( capacity ), std::max( alignof( Entry ), alignof( void * ) ) },
+        hashes_( capacity ), referenced_( ( capacity + 63 ) / 64, 0 ), index_( index_size( capacity ), kEmpty ),
+        size_{ 0 }, hand_{ 0 }, evictions_{ 0 } {}
+
+  ClockCache( const ClockCache & )             = delete;
+  ClockCache & operator=( const ClockCache & ) = delete;
+
+  ~ClockCache() { clear(); }
+
+  /// @return Value for @p key (marking it recently used), or nullptr if absent.
+  V * find( const K & key ) {
+    const std::size_t slot = find_slot( key, hash_( key ) );
+    if ( index_[slot] == kEmpty ) {
+      return nullptr;
+    }
+    const handle h = index_[slot];
+    referenced_[h / 64] |= std::uint64_t{ 1 } << ( h % 64 );
+    return &entry( h ).value;
+  }
+
+  /// @return true if @p key is cached. Does not affect recency.
+  bool contains( const K & key ) const { return const_cast< ClockCache * >( this )->probe( key ) != kEmpty; }
+
+  /**
+   * @brief Insert or replace the value for @p key.
+   *
+   * A replaced value is assigned in place and marked used. A new entry takes a free block while
+   * the cache is below capacity; otherwise it evicts the CLOCK victim and reuses its block.
+   *
+   * @return The cached value.
+   * @throw Whatever constructing or assigning V throws; the cache stays consistent, minus the victim if one was evicted.
+   */
+  template < class... Args > V & put( const K & key, Args &&... args ) {
+    const std::size_t hash = hash_( key );
+    std::size_t       slot = find_slot( key, hash );
+    if ( index_[slot] != kEmpty ) {
+      const handle h = index_[slot];
+      entry( h ).value = V( std::forward< Args >( args )... );
+      referenced_[h / 64] |= std::uint64_t{ 1 } << ( h % 64 );
+      return entry( h ).value;
+    }
+
+    void * block = nullptr;
+    if ( size_ < capacity() ) {
+      block = pool_.allocate();
+    }
+    else {
+      // Recycle the victim's block: destroy in place, no deallocate/allocate pair
+      const handle victim = sweep();
+      remove_from_index( victim );
+      entry( victim ).~Entry();
+      block = pool_.block_at( victim );
+      --size_;
+      ++evictions_;
+      slot = find_slot( key, hash ); // the backward shift may have moved the insertion point
+    }
+
+    try {
+      ::new ( block ) Entry{ key, V( std::forward< Args >( args )... ) };
+    } catch ( ... ) {
+      pool_.deallocate( block );
+      throw;
+    }
+    const handle h = handle_of( block );
+    hashes_[h]     = hash;
+    index_[slot]   = h;
+    referenced_[h / 64] &= ~( std::uint64_t{ 1 } << ( h % 64 ) );
+    ++size_;
+    return entry( h ).value;
+  }
+
+  /**
+   * @brief Remove @p key and return its block to the pool.
+   * @return true if an entry was erased.
+   */
+  bool erase( const K & key ) {
+    const std::size_t slot = find_slot( key, hash_( key ) );
+    if ( index_[slot] == kEmpty ) {
+      return false;
+    }
+    const handle h = index_[slot];
+    remove_slot( slot );
+    entry( h ).~Entry();
+    pool_.deallocate( pool_.block_at( h ) );
+    --size_;
+    return true;
+  }
+
+  /// Destroy all entries. Does not allocate, so the destructor can use it.
+  void clear() {
+    // Thread each emptied block onto a chain through its first bytes; the highest address ends
+    // up first, so the pool's free list comes back in address order
+    void * chain = nullptr;
+    pool_.for_each_allocated( [&]( std::size_t, void * block ) {
+      static_cast< Entry * >( block )->~Entry();
+      *static_cast< void ** >( block ) = chain;
+      chain                            = block;
+    } );
+    pool_.deallocate_chain( chain );
+    std::fill( index_.begin(), index_.end(), kEmpty );
+    std::fill( referenced_.begin(), referenced_.end(), 0 );
+    size_ = 0;
+    hand_ = 0;
+  }
+
+  /// @return Number of cached entries.
+  std::size_t size() const noexcept { return size_; }
+
+  /// @return true if the cache holds no entries.
+  bool empty() const noexcept { return size_ == 0; }
+
+  /// @return Maximum number of entries (the pool's block count).
+  std::size_t capacity() const noexcept { return hashes_.size(); }
+
+  /// @return Entries evicted by put() so far.
+  std::size_t evictions() const noexcept { return evictions_; }
+
+private:
+  using handle = std::uint32_t; // block index of an entry
+
+  struct Entry {
+    K key;
+    V value;
+  };
+
+  static constexpr handle kEmpty = ~handle{ 0 };
+
+  BlockAllocator               pool_;
+  std::vector< std::size_t >   hashes_;     // per block: hash of its key, for probing without rehashing
+  std::vector< std::uint64_t > referenced_; // CLOCK bit per block: used since the hand last passed
+  std::vector< handle >        index_;      // open addressing, power-of-two size, kEmpty = vacant
+  std::size_t                  size_;
+  std::size_t                  hand_;       // next block the CLOCK sweep inspects
+  std::size_t                  evictions_;
+  Hash                         hash_;
+  KeyEqual                     equal_;
+
+  static std::size_t check_capacity( std::size_t capacity ) {
+    if ( capacity == 0 || capacity >= kEmpty ) {
+      throw std::invalid_argument( "ClockCache: capacity must be in [1, 2^32 - 1)" );
+    }
+    return capacity;
+  }
+
+  // At most half full, so probe sequences stay short
+  static std::size_t index_size( std::size_t capacity ) noexcept {
+    std::size_t n = 2;
+    while ( n < 2 * capacity ) {
+      n *= 2;
+    }
+    return n;
+  }
+
+  Entry & entry( handle h ) noexcept { return *static_cast< Entry * >( pool_.block_at( h ) ); }
+
+  handle handle_of( const void * block ) const noexcept {
+    return static_cast< handle >( static_cast< std::size_t >( static_cast< const std::byte * >( block ) -
+                                                              static_cast< const std::byte * >( pool_.block_at( 0 ) ) ) /
+                                  pool_.stride() );
+  }
+
+  // Slot holding @p key, or the vacant slot where it would go
+  std::size_t find_slot( const K & key, std::size_t hash ) {
+    const std::size_t mask = index_.size() - 1;
+    for ( std::size_t slot = hash & mask;; slot = ( slot + 1 ) & mask ) {
+      const handle h = index_[slot];
+      if ( h == kEmpty || ( hashes_[h] == hash && equal_( entry( h ).key, key ) ) ) {
+        return slot;
+      }
+    }
+  }
+
+  handle probe( const K & key ) { return index_[find_slot( key, hash_( key ) )]; }
+
+  void remove_from_index( handle h ) {
+    const std::size_t mask = index_.size() - 1;
+    std::size_t       slot = hashes_[h] & mask;
+    while ( index_[slot] != h ) {
+      slot = ( slot + 1 ) & mask;
+    }
+    remove_slot( slot );
+  }
+
+  // Backward-shift deletion: pull later entries of the probe run into the hole
+  void remove_slot( std::size_t hole ) noexcept {
+    const std::size_t mask = index_.size() - 1;
+    for ( std::size_t next = ( hole + 1 ) & mask; index_[next] != kEmpty; next = ( next + 1 ) & mask ) {
+      const std::size_t home = hashes_[index_[next]] & mask;
+      // Move unless the entry's home lies cyclically in (hole, next]
+      if ( ( ( next - home ) & mask ) >= ( ( next - hole ) & mask ) ) {
+        index_[hole] = index_[next];
+        hole         = next;
+      }
+    }
+    index_[hole] = kEmpty;
+  }
+
+  // Advance the hand to the first block not used since the last pass, clearing bits on the way
+  handle sweep() noexcept {
+    const std::size_t n = capacity();
+    for ( ;; ) {
+      const std::size_t   w      = hand_ / 64;
+      const std::size_t   end    = std::min< std::size_t >( 64, n - w * 64 ); // blocks in this word
+      std::uint64_t       span   = end == 64 ? ~std::uint64_t{ 0 } : ( std::uint64_t{ 1 } << end ) - 1;
+      span                      &= ~std::uint64_t{ 0 } << ( hand_ % 64 );
+      const std::uint64_t unused = ~referenced_[w] & span;
+      if ( unused != 0 ) {
+        const auto victim = static_cast< std::size_t >( __builtin_ctzll( unused ) );
+        span &= ( std::uint64_t{ 1 } << victim ) - 1; // second chance for the used ones passed over
+        referenced_[w] &= ~span;
+        hand_ = w * 64 + victim + 1 == n ? 0 : w * 64 + victim + 1;
+        return static_cast< handle >( w * 64 + victim );
+      }
+      referenced_[w] &= ~span;
+      hand_ = ( w + 1 ) * 64 >= n ? 0 : ( w + 1 ) * 64;
+    }
+  }
+};
+} // namespace mem
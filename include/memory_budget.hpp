@@ -0,0 +1,103 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/**
+ * @file memory_budget.hpp
+ * @brief Process-level memory budget shared by many pools.
+ *
+ * Pools attached to a MemoryBudget (see BlockAllocatorOptions::budget) charge the pages they
+ * commit against it and uncharge them when they decommit or are destroyed. Charging happens
+ * only when a pool commits or decommits pages, never per block, so allocate() and
+ * deallocate() are unaffected. When a pool wants to grow past the soft limit, the budget
+ * first asks the other parties to give memory back through their reclaim callbacks; growth
+ * past the hard limit fails.
+ *
+ * @copyright
+ * No license. See README.md for details.
+ */
+namespace mem {
+/**
+ * @class MemoryBudget
+ * @brief Soft/hard byte limits with reclaim callbacks.
+ *
+ * Attached pools register a callback that decommits their free tail
+ * (BlockAllocator::decommit_free_tail()); caches and other layers can add their own. Slabs
+ * parked in a PagePool are not charged to anyone.
+ *
+ * @note Must outlive every pool attached to it. All methods are thread-safe.
+ */
+class MemoryBudget final {
+public:
+  /// Asked to give back about the given number of bytes; returns how many it uncharged.
+  using ReclaimCallback = std::function< std::size_t( std::size_t bytes ) >;
+
+  /**
+   * @brief Create a budget.
+   * @param hard_limit Charges never take used() above this.
+   * @param soft_limit Growth beyond this first runs reclaim callbacks (0 = same as @p hard_limit).
+   * @throw std::invalid_argument if @p hard_limit is 0 or @p soft_limit exceeds it.
+   */
+  explicit MemoryBudget( std::size_t hard_limit, std::size_t soft_limit = 0 );
+
+  MemoryBudget( const MemoryBudget & )             = delete;
+  MemoryBudget & operator=( const MemoryBudget & ) = delete;
+
+  /// @return Bytes currently charged.
+  std::size_t used() const noexcept { return used_.load( std::memory_order_relaxed ); }
+
+  /// @return The soft limit in bytes.
+  std::size_t soft_limit() const noexcept { return soft_; }
+
+  /// @return The hard limit in bytes.
+  std::size_t hard_limit() const noexcept { return hard_; }
+
+  /**
+   * @brief Charge @p bytes if that keeps used() within the hard limit. Lock-free.
+   * @return true if charged.
+   */
+  bool charge( std::size_t bytes ) noexcept;
+
+  /// Return @p bytes previously charged.
+  void uncharge( std::size_t bytes ) noexcept;
+
+  /**
+   * @brief Register a reclaim callback.
+   * @return Id for remove_reclaimer() (never 0).
+   */
+  std::size_t add_reclaimer( ReclaimCallback callback );
+
+  /// Unregister a callback; waits for a reclaim pass that is running it to finish.
+  void remove_reclaimer( std::size_t id );
+
+  /**
+   * @brief Ask reclaim callbacks, round-robin, for about @p bytes.
+   *
+   * Only one pass runs at a time: a call made while another pass is running (including from
+   * inside a callback) returns 0 at once instead of blocking.
+   *
+   * @param bytes Bytes wanted.
+   * @param skip Callback id to leave out, typically the caller's own (0 = none).
+   * @return Bytes the callbacks reported giving back.
+   */
+  std::size_t reclaim( std::size_t bytes, std::size_t skip = 0 );
+
+private:
+  struct Reclaimer {
+    std::size_t     id;
+    ReclaimCallback callback;
+  };
+
+  const std::size_t          hard_;
+  const std::size_t          soft_;
+  std::atomic< std::size_t > used_;
+
+  std::mutex               mtx_; // guards the fields below; held for a whole reclaim pass
+  std::vector< Reclaimer > reclaimers_;
+  std::size_t              next_id_;
+  std::size_t              cursor_; // where the next pass starts, so no party is always trimmed first
+};
+} // namespace mem
@@ -0,0 +1,74 @@
+#pragma once
+#include "block_allocator.hpp"
+
+#include <cstddef>
+
+/**
+ * @file monotonic_arena.hpp
+ * @brief Bump-pointer arena whose chunks are blocks of a BlockAllocator.
+ *
+ * Variable-size scratch allocations are carved from the current chunk by bumping a pointer.
+ * Chunks come from a (typically large-block) BlockAllocator, so total scratch memory is
+ * bounded by that pool's capacity, and releasing the arena hands every chunk back without
+ * allocating.
+ *
+ * @copyright
+ * No license. See README.md for details.
+ */
+namespace mem {
+/**
+ * @class MonotonicArena
+ * @brief Monotonic (release-all-at-once) arena layered on a fixed-block pool.
+ *
+ * Chunks are threaded through a link stored in their first bytes, so the arena itself
+ * performs no heap allocation. Individual allocations are never freed; call release() or
+ * destroy the arena to return everything.
+ *
+ * @note Not thread-safe: intended for one request or one thread at a time. The chunk pool
+ *       itself may be shared between arenas on different threads.
+ */
+class MonotonicArena final {
+public:
+  /**
+   * @brief Create an empty arena drawing chunks from @p chunks.
+   * @param chunks Pool providing the chunks; must outlive the arena.
+   */
+  explicit MonotonicArena( BlockAllocator & chunks ) noexcept;
+
+  MonotonicArena( const MonotonicArena & )             = delete;
+  MonotonicArena & operator=( const MonotonicArena & ) = delete;
+
+  /// Returns all chunks to the pool.
+  ~MonotonicArena() noexcept;
+
+  /**
+   * @brief Allocate @p size bytes aligned to @p alignment.
+   * @param size Number of bytes (0 is treated as 1).
+   * @param alignment Power-of-two alignment.
+   * @return Pointer valid until release() or destruction.
+   * @throw std::invalid_argument if @p alignment is not a power of two.
+   * @throw std::bad_alloc if the request cannot fit in a chunk or the chunk pool is exhausted.
+   */
+  void * allocate( std::size_t size, std::size_t alignment = alignof( std::max_align_t ) );
+
+  /// Return every chunk to the pool without allocating; previously returned pointers become invalid.
+  void release() noexcept;
+
+  /// @return Number of chunks currently held.
+  std::size_t chunk_count() const noexcept { return chunk_count_; }
+
+  /// @return Largest allocation (at chunk alignment) a single chunk can satisfy.
+  std::size_t max_allocation() const noexcept;
+
+private:
+  struct ChunkHeader {
+    ChunkHeader * prev;
+  };
+
+  BlockAllocator & chunks_;
+  ChunkHeader *    head_;        // most recent chunk
+  std::byte *      cur_;         // bump pointer within head_
+  std::byte *      end_;         // end of head_'s usable bytes
+  std::size_t      chunk_count_;
+};
+} // namespace mem
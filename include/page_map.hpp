@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * @file page_map.hpp
+ * @brief Process-wide map from an address to the BlockAllocator that owns it, for freeing without the pool at hand.
+ *
+ * Every BlockAllocator registers its committed pages: the initial ones when it is constructed,
+ * new ones as it grows, and removes them as it decommits or donates pages and when it is
+ * destroyed, so the map's footprint follows memory in use rather than reserved address space.
+ * The map is a three-level radix tree over 4 KiB page numbers, like tcmalloc's pagemap: a
+ * lookup is three dependent loads with no lock. Interior nodes are allocated on first use and
+ * never freed, so a racing lookup never sees a node disappear.
+ *
+ * @copyright
+ * No license. See README.md for details.
+ */
+namespace mem {
+class BlockAllocator;
+
+/**
+ * @class PageMap
+ * @brief Static registry of committed pool pages, keyed by 4 KiB page.
+ *
+ * Lookups are lock-free and wait-free; registration takes a global mutex. Addresses at or above
+ * 2^48 (only handed out by mmap when asked for) are not covered.
+ */
+class PageMap final {
+public:
+  PageMap() = delete;
+
+  /**
+   * @brief Map every page of [@p base, @p base + @p bytes) to @p owner.
+   * @param base Page-aligned start of the range.
+   * @return false if the range is not covered by the map; nothing is registered then.
+   * @throw std::bad_alloc if tree nodes cannot be allocated; nothing is registered then.
+   */
+  static bool insert( const void * base, std::size_t bytes, BlockAllocator * owner );
+
+  /// Clear the pages of [@p base, @p base + @p bytes) registered by insert().
+  static void erase( const void * base, std::size_t bytes ) noexcept;
+
+  /// @return The pool whose committed pages contain @p p, or nullptr.
+  static BlockAllocator * find( const void * p ) noexcept;
+};
+
+/// @return The pool whose committed pages contain @p p, or nullptr. Shorthand for PageMap::find().
+inline BlockAllocator * owner_of( const void * p ) noexcept { return PageMap::find( p ); }
+
+/**
+ * @brief Return @p p to whichever BlockAllocator it came from.
+ * @param p Pointer obtained from any live BlockAllocator. nullptr is ignored.
+ * @throw std::runtime_error if no live pool owns @p p, or as BlockAllocator::deallocate() does.
+ */
+void deallocate( void * p );
+} // namespace mem
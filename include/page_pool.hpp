@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/**
+ * @file page_pool.hpp
+ * @brief Shared holding area for whole slabs of resident pages donated by block pools.
+ *
+ * Pools of different size classes attached to the same PagePool (see
+ * BlockAllocatorOptions::page_pool) rebalance memory through it: a pool whose tail is free
+ * moves those pages out with BlockAllocator::donate_free_slabs(), and a pool that needs to
+ * grow adopts them before committing new pages. Pages are moved with mremap(), so they stay
+ * resident and are never copied or zeroed on the way.
+ *
+ * @copyright
+ * No license. See README.md for details.
+ */
+namespace mem {
+/**
+ * @class PagePool
+ * @brief Thread-safe stack of equally sized anonymous mappings ("slabs").
+ *
+ * The pool owns every slab it holds and unmaps them on destruction or trim(). Slabs handed in
+ * beyond max_bytes() are unmapped immediately, so the memory parked here stays bounded.
+ *
+ * @note Must outlive every BlockAllocator attached to it. All methods are thread-safe.
+ */
+class PagePool final {
+public:
+  /**
+   * @brief Create an empty page pool.
+   * @param slab_bytes Size of one slab; a multiple of the page size.
+   * @param max_bytes Most bytes held at once (0 = unlimited).
+   * @throw std::invalid_argument if @p slab_bytes is 0 or not a multiple of the page size.
+   */
+  explicit PagePool( std::size_t slab_bytes = 64 * 1024, std::size_t max_bytes = 0 );
+
+  PagePool( const PagePool & )             = delete;
+  PagePool & operator=( const PagePool & ) = delete;
+
+  /// Unmaps every held slab.
+  ~PagePool() noexcept;
+
+  /// @return Bytes per slab.
+  std::size_t slab_bytes() const noexcept { return slab_bytes_; }
+
+  /// @return Limit on held bytes (0 = unlimited).
+  std::size_t max_bytes() const noexcept { return max_bytes_; }
+
+  /// @return Number of slabs currently held.
+  std::size_t held_slabs() const noexcept;
+
+  /// @return Bytes currently held.
+  std::size_t held_bytes() const noexcept { return held_slabs() * slab_bytes_; }
+
+  /**
+   * @brief Take ownership of a slab_bytes() mapping.
+   * @return true if the slab was kept, false if the pool was full and it was unmapped instead.
+   */
+  bool put( void * slab ) noexcept;
+
+  /// @return The most recently donated slab (still the most likely to be cache-warm), or nullptr if empty.
+  void * take() noexcept;
+
+  /**
+   * @brief Unmap held slabs beyond @p keep_slabs.
+   * @return Number of bytes returned to the kernel.
+   */
+  std::size_t trim( std::size_t keep_slabs = 0 ) noexcept;
+
+private:
+  const std::size_t slab_bytes_;
+  const std::size_t max_bytes_;
+
+  mutable std::mutex    mtx_;
+  std::vector< void * > slabs_; // most recently donated last
+};
+} // namespace mem
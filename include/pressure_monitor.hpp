@@ -0,0 +1,124 @@
+#pragma once
+#include "block_allocator.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @file pressure_monitor.hpp
+ * @brief cgroup v2 memory-pressure (PSI) driven trimming and pool sizing.
+ *
+ * The monitor reads `memory.max` and `memory.pressure` from a cgroup directory. When the
+ * "some" avg10 stall percentage crosses a threshold, it releases free pages of every watched
+ * pool and runs registered shrink callbacks (for caching layers). The directory is a plain
+ * constructor argument, so tests can point it at a fake cgroup tree.
+ *
+ * @copyright
+ * No license. See README.md for details.
+ */
+namespace mem {
+/// One reading of a cgroup's memory limit and pressure.
+struct PressureSample {
+  std::optional< std::size_t > memory_max; ///< Limit in bytes, empty if "max" or unreadable.
+  double                       some_avg10; ///< % of time some tasks stalled on memory (10 s window).
+  double                       full_avg10; ///< % of time all tasks stalled on memory (10 s window).
+};
+
+/**
+ * @class PressureMonitor
+ * @brief Polls cgroup PSI and trims watched pools when memory pressure rises.
+ *
+ * Action is edge-triggered: it fires when some avg10 rises to or above the threshold and is
+ * re-armed once pressure drops back below it, so a sustained stall does not trim on every poll.
+ *
+ * @note All methods are safe to call from multiple threads concurrently.
+ */
+class PressureMonitor final {
+public:
+  using ShrinkCallback = std::function< void( const PressureSample & ) >;
+
+  /**
+   * @brief Create a monitor for the cgroup at @p cgroup_dir.
+   * @param cgroup_dir Directory containing memory.max and memory.pressure.
+   * @param threshold_avg10 "some" avg10 percentage at which to act.
+   */
+  explicit PressureMonitor( std::string cgroup_dir = "/sys/fs/cgroup", double threshold_avg10 = 10.0 );
+
+  PressureMonitor( const PressureMonitor & )             = delete;
+  PressureMonitor & operator=( const PressureMonitor & ) = delete;
+
+  /// Stops the background thread, if any.
+  ~PressureMonitor() noexcept;
+
+  /// Trim @p pool (release_free_pages()) under pressure. The pool must outlive the monitor or be unwatched first.
+  void watch( BlockAllocator & pool );
+
+  /// Stop trimming @p pool.
+  void unwatch( BlockAllocator & pool );
+
+  /// Register a callback run under pressure, e.g. to shrink a cache layered on a pool. Callbacks run without the monitor's lock.
+  void on_pressure( ShrinkCallback callback );
+
+  /**
+   * @brief Read the cgroup files.
+   * @throw std::runtime_error if memory.pressure cannot be read or parsed.
+   */
+  PressureSample sample() const;
+
+  /**
+   * @brief Take one sample and act if pressure has risen past the threshold.
+   * @return true if pools were trimmed and callbacks run.
+   * @throw std::runtime_error if memory.pressure cannot be read or parsed.
+   */
+  bool poll();
+
+  /// @return Total bytes released from watched pools so far.
+  std::size_t bytes_released() const noexcept;
+
+  /**
+   * @brief Poll every @p interval on a background thread (read errors are ignored there).
+   * @throw std::logic_error if already running.
+   */
+  void start( std::chrono::milliseconds interval );
+
+  /// Stop the background thread.
+  void stop() noexcept;
+
+  /// @return The limit in `<cgroup_dir>/memory.max`, or empty if unlimited or unreadable.
+  static std::optional< std::size_t > memory_limit( const std::string & cgroup_dir );
+
+  /**
+   * @brief Size a pool from the cgroup limit.
+   * @param cgroup_dir Directory containing memory.max.
+   * @param block_bytes Bytes per block (use the pool's stride for an exact fit).
+   * @param fraction Share of the limit the pool may take, in (0, 1].
+   * @param fallback Block count to use when the cgroup is unlimited or unreadable.
+   * @return floor( limit * fraction / block_bytes ), at least 1, or @p fallback.
+   * @throw std::invalid_argument if @p block_bytes is 0 or @p fraction is outside (0, 1].
+   */
+  static std::size_t block_count_for_limit( const std::string & cgroup_dir, std::size_t block_bytes, double fraction,
+                                            std::size_t fallback );
+
+private:
+  const std::string cgroup_dir_;
+  const double      threshold_;
+
+  mutable std::mutex              mtx_;
+  std::vector< BlockAllocator * > pools_;
+  std::vector< ShrinkCallback >   callbacks_;
+  bool                            armed_;
+  std::size_t                     released_;
+
+  std::mutex              thread_mtx_;
+  std::condition_variable thread_cv_;
+  bool                    stop_;
+  std::thread             worker_;
+};
+} // namespace mem
@@ -0,0 +1,233 @@
+#pragma once
+#include "block_allocator.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @file segmented_vector.hpp
+ * @brief Growable sequence with stable element addresses, stored in BlockAllocator blocks.
+ *
+ * Elements live in fixed-size segments, one pool block each, and never move: growth only
+ * appends segments, so pointers and references stay valid until the element is removed. The
+ * segment table holds 32-bit block indices rather than pointers, and segment sizes are
+ * powers of two, so indexing is one shift, one mask and one table load. Memory is committed a
+ * segment at a time from a pool reserved up front for max_size() elements.
+ *
+ * @copyright
+ * No license. See README.md for details.
+ */
+namespace mem {
+/**
+ * @class SegmentedVector
+ * @brief Pointer-stable alternative to std::deque with O(1) indexing and batched segment allocation.
+ *
+ * @tparam T Element type.
+ * @note Like standard containers, a SegmentedVector is not safe for concurrent mutation.
+ */
+template < class T > class SegmentedVector final {
+public:
+  using value_type = T;
+  using handle     = std::uint32_t; // block index of a segment
+
+  static constexpr std::size_t kDefaultSegmentSize = std::max< std::size_t >( 1, 4096 / sizeof( T ) );
+
+  /**
+   * @brief Construct an empty vector able to grow to @p max_size elements.
+   * @param max_size Upper bound on size(); address space for it is reserved, not committed.
+   * @param segment_size Elements per segment; rounded down to a power of two.
+   * @throw std::invalid_argument if @p max_size or @p segment_size is 0, or more than 2^32 segments would be needed.
+   * @throw std::bad_alloc if the pool cannot be reserved.
+   */
+  explicit SegmentedVector( std::size_t max_size, std::size_t segment_size = kDefaultSegmentSize )
+      : shift_{ check_shift( max_size, segment_size ) }, mask_{ ( std::size_t{ 1 } << shift_ ) - 1 },
+        max_size_{ max_size }, pool_{ sizeof( T ) << shift_, 1, std::max( alignof( T ), alignof( void * ) ),
+                                      pool_options( max_size, shift_ ) },
+        size_{ 0 }, end_{ nullptr } {}
+
+  SegmentedVector( const SegmentedVector & )             = delete;
+  SegmentedVector & operator=( const SegmentedVector & ) = delete;
+
+  ~SegmentedVector() { clear(); }
+
+  /// @return Element @p i. No bounds check.
+  T & operator[]( std::size_t i ) noexcept { return static_cast< T * >( pool_.block_at( table_[i >> shift_] ) )[i & mask_]; }
+
+  /// @copydoc operator[]
+  const T & operator[]( std::size_t i ) const noexcept {
+    return static_cast< const T * >( pool_.block_at( table_[i >> shift_] ) )[i & mask_];
+  }
+
+  /// @return Element @p i. @throw std::out_of_range if @p i >= size().
+  T & at( std::size_t i ) {
+    if ( i >= size_ ) {
+      throw std::out_of_range( "SegmentedVector::at: index out of range" );
+    }
+    return ( *this )[i];
+  }
+
+  /// @return Last element. size() must be > 0.
+  T & back() noexcept { return ( *this )[size_ - 1]; }
+
+  /**
+   * @brief Construct an element at the end.
+   * @throw std::length_error if size() == max_size().
+   * @throw std::bad_alloc if no segment can be allocated.
+   */
+  template < class... Args > T & emplace_back( Args &&... args ) {
+    if ( ( size_ & mask_ ) == 0 || size_ == max_size_ ) {
+      reserve_for( 1 );
+    }
+    T * slot = end_slot();
+    ::new ( slot ) T( std::forward< Args >( args )... );
+    end_ = slot + 1;
+    ++size_;
+    return *slot;
+  }
+
+  /// @copydoc emplace_back
+  void push_back( const T & value ) { emplace_back( value ); }
+
+  /// @copydoc emplace_back
+  void push_back( T && value ) { emplace_back( std::move( value ) ); }
+
+  /// Destroy the last element; its segment is kept for reuse. size() must be > 0.
+  void pop_back() noexcept {
+    --size_;
+    end_ = &( *this )[size_];
+    end_->~T();
+  }
+
+  /**
+   * @brief Append @p n copies of @p value; all segments needed are taken in one allocate_all().
+   * @throw std::length_error if max_size() would be exceeded.
+   * @throw std::bad_alloc if the segments cannot be allocated.
+   */
+  void append( std::size_t n, const T & value ) {
+    reserve_for( n );
+    for ( std::size_t i = 0; i < n; ++i ) {
+      T * slot = end_slot();
+      ::new ( slot ) T( value );
+      end_ = slot + 1;
+      ++size_;
+    }
+  }
+
+  /// @copybrief append(std::size_t,const T&) Copies [@p first, @p last); requires forward iterators.
+  template < class It > void append( It first, It last ) {
+    static_assert( std::is_base_of< std::forward_iterator_tag, typename std::iterator_traits< It >::iterator_category >::value,
+                   "SegmentedVector::append needs forward iterators" );
+    reserve_for( static_cast< std::size_t >( std::distance( first, last ) ) );
+    for ( ; first != last; ++first ) {
+      T * slot = end_slot();
+      ::new ( slot ) T( *first );
+      end_ = slot + 1;
+      ++size_;
+    }
+  }
+
+  /// Destroy all elements and return every segment to the pool in one deallocate_chain(), without allocating.
+  void clear() {
+    if ( !std::is_trivially_destructible< T >::value ) {
+      for ( std::size_t i = 0; i < size_; ++i ) {
+        ( *this )[i].~T();
+      }
+    }
+    size_ = 0;
+    release_segments( 0 );
+  }
+
+  /// Return segments beyond those holding elements to the pool.
+  void shrink_to_fit() { release_segments( ( size_ + mask_ ) >> shift_ ); }
+
+  /// @return Number of elements.
+  std::size_t size() const noexcept { return size_; }
+
+  /// @return true if the vector holds no elements.
+  bool empty() const noexcept { return size_ == 0; }
+
+  /// @return Elements that fit in the segments held now.
+  std::size_t capacity() const noexcept { return table_.size() << shift_; }
+
+  /// @return Largest size() the vector can reach.
+  std::size_t max_size() const noexcept { return max_size_; }
+
+  /// @return Elements per segment (a power of two).
+  std::size_t segment_size() const noexcept { return mask_ + 1; }
+
+private:
+  const unsigned        shift_;
+  const std::size_t     mask_;
+  const std::size_t     max_size_;
+  BlockAllocator        pool_;
+  std::vector< handle > table_; // segment i holds elements [i << shift_, (i + 1) << shift_)
+  std::size_t           size_;
+  T *                   end_; // address of element size_ while it falls inside a segment (size_ & mask_ != 0)
+
+  // Address of element size_, whose segment must exist; skips the table inside a segment
+  T * end_slot() noexcept { return ( size_ & mask_ ) != 0 ? end_ : &( *this )[size_]; }
+
+  static unsigned check_shift( std::size_t max_size, std::size_t segment_size ) {
+    if ( max_size == 0 || segment_size == 0 ) {
+      throw std::invalid_argument( "SegmentedVector: max_size and segment_size must be > 0" );
+    }
+    const auto shift = static_cast< unsigned >( 63 - __builtin_clzll( segment_size ) );
+    if ( ( ( max_size - 1 ) >> shift ) >= ( std::size_t{ 1 } << 32 ) ) {
+      throw std::invalid_argument( "SegmentedVector: max_size needs more than 2^32 segments" );
+    }
+    return shift;
+  }
+
+  static BlockAllocatorOptions pool_options( std::size_t max_size, unsigned shift ) {
+    BlockAllocatorOptions options;
+    options.reserve_blocks = ( ( max_size - 1 ) >> shift ) + 1;
+    return options;
+  }
+
+  // Make room for @p n more elements, taking the missing segments in one transaction
+  void reserve_for( std::size_t n ) {
+    if ( n > max_size_ - size_ ) {
+      throw std::length_error( "SegmentedVector: max_size exceeded" );
+    }
+    const std::size_t need = ( ( size_ + n + mask_ ) >> shift_ );
+    if ( need <= table_.size() ) {
+      return;
+    }
+    const std::size_t     k = need - table_.size();
+    std::vector< void * > blocks( k );
+    if ( need > table_.capacity() ) {
+      // Before allocating, so recording the handles cannot throw
+      table_.reserve( std::max( need, 2 * table_.capacity() ) );
+    }
+    if ( !pool_.allocate_all( blocks.data(), k ) ) {
+      throw std::bad_alloc();
+    }
+    for ( void * block : blocks ) {
+      table_.push_back( static_cast< handle >( pool_.index_of( block ) ) );
+    }
+  }
+
+  void release_segments( std::size_t keep ) {
+    if ( keep >= table_.size() ) {
+      return;
+    }
+    // The segments hold no elements: link them through their first bytes rather than an array,
+    // so clear() from the destructor never touches the heap. Segment keep is reused first.
+    void * chain = nullptr;
+    for ( std::size_t i = keep; i < table_.size(); ++i ) {
+      void * block                     = pool_.block_at( table_[i] );
+      *static_cast< void ** >( block ) = chain;
+      chain                            = block;
+    }
+    pool_.deallocate_chain( chain );
+    table_.resize( keep );
+  }
+};
+} // namespace mem
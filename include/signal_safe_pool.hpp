@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @file signal_safe_pool.hpp
+ * @brief Fixed-size block pool whose allocate()/deallocate() may be called from signal handlers.
+ *
+ * BlockAllocator takes a std::mutex, so a signal handler that allocates while the interrupted
+ * thread holds the lock deadlocks. SignalSafePool is a companion for code that runs in that
+ * context (sampling profilers, crash handlers): its hot paths use only lock-free atomics on
+ * memory set up by the constructor.
+ *
+ * @copyright
+ * No license. See README.md for details.
+ */
+namespace mem {
+/**
+ * @class SignalSafePool
+ * @brief Lock-free, async-signal-safe pool of equally sized blocks.
+ *
+ * Guarantees for allocate(), deallocate(), owns() and free_blocks():
+ * - no locks, no system calls, no malloc, no thread-local storage and no exceptions;
+ * - lock-free (a CAS loop on a 64-bit word, which is checked at compile time to be lock-free),
+ *   so they may interrupt themselves in the same thread and run concurrently in many threads;
+ * - no page faults: all pages are populated by the constructor.
+ *
+ * Free blocks form a Treiber stack whose links live in an out-of-band array, never in the
+ * blocks; the head packs the top block index with a 32-bit version counter so a pop that
+ * raced with pop/push cycles (ABA) fails its CAS and retries. Exhaustion and misuse are
+ * reported by return value instead of exceptions. The pool has a fixed size and never grows.
+ *
+ * Construction and destruction are not signal-safe and must happen outside handlers, with no
+ * handler able to use the pool during either.
+ */
+class SignalSafePool final {
+public:
+  /**
+   * @brief Create a pool and populate all of its pages.
+   * @param block_size Size of each block in bytes.
+   * @param block_count Number of blocks.
+   * @param alignment Block alignment; a power of two.
+   * @throw std::invalid_argument on zero sizes, a bad alignment, or more than 2^32 - 1 blocks.
+   * @throw std::bad_alloc if the region cannot be mapped.
+   */
+  SignalSafePool( std::size_t block_size, std::size_t block_count, std::size_t alignment = alignof( std::max_align_t ) );
+
+  SignalSafePool( const SignalSafePool & )             = delete;
+  SignalSafePool & operator=( const SignalSafePool & ) = delete;
+
+  /// Unmaps the region; outstanding blocks become invalid.
+  ~SignalSafePool() noexcept;
+
+  /// @return A block of block_size() bytes, or nullptr if the pool is exhausted. Async-signal-safe.
+  void * allocate() noexcept;
+
+  /**
+   * @brief Return a block. Async-signal-safe; nullptr is ignored.
+   * @return false (and no effect) if @p p is not a block of this pool or is not allocated.
+   */
+  bool deallocate( void * p ) noexcept;
+
+  /// @return true if @p p is the start of a block of this pool. Async-signal-safe.
+  bool owns( const void * p ) const noexcept;
+
+  /// @return Number of free blocks (a snapshot under concurrency). Async-signal-safe.
+  std::size_t free_blocks() const noexcept { return free_.load( std::memory_order_relaxed ); }
+
+  /// @return Requested payload size in bytes.
+  std::size_t block_size() const noexcept { return block_size_; }
+
+  /// @return Number of blocks.
+  std::size_t block_count() const noexcept { return block_count_; }
+
+  /// @return Distance between consecutive blocks in bytes.
+  std::size_t stride() const noexcept { return stride_; }
+
+private:
+  static constexpr std::uint32_t kNil = ~std::uint32_t{ 0 }; // end of the free stack
+
+  static_assert( std::atomic< std::uint64_t >::is_always_lock_free, "SignalSafePool needs a lock-free 64-bit CAS" );
+
+  const std::size_t block_size_;
+  const std::size_t block_count_;
+  std::size_t       stride_;
+  std::byte *       map_base_;
+  std::size_t       map_bytes_;
+  std::byte *       region_;
+
+  std::unique_ptr< std::atomic< std::uint32_t >[] > next_;      // free-stack link per block
+  std::unique_ptr< std::atomic< std::uint64_t >[] > allocated_; // bit per block: catches double and foreign frees
+  std::atomic< std::uint64_t >                      head_;      // (version << 32) | index of the top free block
+  std::atomic< std::size_t >                        free_;
+};
+} // namespace mem
@@ -0,0 +1,135 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * @file size_class_heap.hpp
+ * @brief Several size classes sharing one region, SLUB style: pages are assigned to a class on demand.
+ *
+ * A BlockAllocator per size needs its capacity planned per class. SizeClassHeap instead splits
+ * one reserved region into equal pages (64 KiB by default). A page is given to a size class
+ * when that class runs out of partially used pages, keeps its own free list and free count in
+ * a page descriptor, and goes back to the shared free-page stack as soon as its last block is
+ * freed, ready for any class. Blocks of one page are all of one size, so a page's blocks sit
+ * together and an empty page can be trimmed as a whole.
+ *
+ * @copyright
+ * No license. See README.md for details.
+ */
+namespace mem {
+/**
+ * @class SizeClassHeap
+ * @brief Thread-safe mixed-size allocator over one region of class-assigned pages.
+ *
+ * Block sizes are rounded up to the smallest class that fits; every block is aligned to 16
+ * bytes. Pages are carved lazily, so pages and blocks never handed out are never touched.
+ *
+ * @note Blocks larger than the largest class are not supported; use a BlockAllocator or the system allocator.
+ */
+class SizeClassHeap final {
+public:
+  /// Default classes: roughly 1.5x steps from 16 bytes to 8 KiB.
+  static const std::vector< std::size_t > & default_classes();
+
+  /**
+   * @brief Reserve the region and set up the classes.
+   * @param region_bytes Size of the shared region; rounded down to whole pages.
+   * @param class_sizes Block sizes, ascending; each is rounded up to a multiple of 16 (empty = default_classes()).
+   * @param page_bytes Page size; a power of two and a multiple of the system page size.
+   * @throw std::invalid_argument on a bad page size, a region smaller than one page, unsorted classes,
+   *        or a class larger than a page.
+   * @throw std::bad_alloc if the region cannot be reserved.
+   */
+  explicit SizeClassHeap( std::size_t region_bytes, std::vector< std::size_t > class_sizes = {},
+                          std::size_t page_bytes = 64 * 1024 );
+
+  SizeClassHeap( const SizeClassHeap & )             = delete;
+  SizeClassHeap & operator=( const SizeClassHeap & ) = delete;
+
+  /// Unmaps the region; outstanding blocks become invalid.
+  ~SizeClassHeap() noexcept;
+
+  /**
+   * @brief Allocate a block of at least @p size bytes.
+   * @throw std::bad_alloc if @p size is 0 or exceeds the largest class, or no page is available.
+   */
+  void * allocate( std::size_t size );
+
+  /**
+   * @brief Return a block; its page goes back to the free-page stack once empty.
+   * @throw std::runtime_error on a pointer that is not a live block of this heap (nullptr is ignored).
+   */
+  void deallocate( void * p );
+
+  /**
+   * @brief Release the memory of free pages to the kernel (MADV_DONTNEED); they stay reusable.
+   * @return Number of bytes released.
+   */
+  std::size_t trim();
+
+  /// @return Usable size of the block at @p p (its class size).
+  std::size_t block_size_of( const void * p ) const;
+
+  /// @return Number of size classes.
+  std::size_t class_count() const noexcept { return classes_.size(); }
+
+  /// @return Block size of class @p c.
+  std::size_t class_size( std::size_t c ) const noexcept { return classes_[c].size; }
+
+  /// @return Pages currently assigned to class @p c.
+  std::size_t class_pages( std::size_t c ) const noexcept;
+
+  /// @return Bytes per page.
+  std::size_t page_bytes() const noexcept { return page_bytes_; }
+
+  /// @return Number of pages in the region.
+  std::size_t page_count() const noexcept { return pages_.size(); }
+
+  /// @return Pages not assigned to any class.
+  std::size_t free_pages() const noexcept;
+
+private:
+  static constexpr std::uint32_t kNone = ~std::uint32_t{ 0 };
+
+  struct FreeNode {
+    FreeNode * next;
+  };
+
+  // Per-page descriptor, kept out of the page so an empty page holds no live data
+  struct Page {
+    FreeNode *    free_list; // freed blocks of this page
+    std::uint32_t cls;       // size class, kNone while on the free-page stack
+    std::uint32_t free;      // free blocks (listed + not yet carved)
+    std::uint32_t bump;      // blocks [bump, capacity) were never handed out
+    std::uint32_t prev;      // neighbours in the class's partial list, or the free-page stack (next only)
+    std::uint32_t next;
+    bool          released;  // memory returned to the kernel and not touched since
+  };
+
+  struct SizeClass {
+    std::size_t   size;     // block size (multiple of 16)
+    std::uint32_t capacity; // blocks per page
+    std::uint32_t partial;  // first page with a free block, or kNone
+    std::size_t   pages;    // pages assigned to the class
+  };
+
+  const std::size_t page_bytes_;
+  unsigned          page_shift_;
+  std::byte *       map_base_;
+  std::size_t       map_bytes_;
+  std::byte *       region_;
+
+  mutable std::mutex           mtx_;
+  std::vector< SizeClass >     classes_;
+  std::vector< std::uint8_t >  class_of_;   // class index by ( size + 15 ) / 16
+  std::vector< Page >          pages_;
+  std::uint32_t                free_pages_; // top of the free-page stack, linked through Page::next
+  std::size_t                  free_page_count_;
+  std::vector< std::uint64_t > live_;       // bit per 16-byte granule: an allocated block starts here
+
+  void unlink_partial( SizeClass & sc, std::uint32_t page ) noexcept;
+  void push_partial( SizeClass & sc, std::uint32_t page ) noexcept;
+};
+} // namespace mem
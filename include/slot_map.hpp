@@ -0,0 +1,170 @@
+#pragma once
+#include "block_allocator.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+ * @file slot_map.hpp
+ * @brief Slot map with stable 32-bit keys whose elements live in a BlockAllocator pool.
+ *
+ * Each element occupies one block of a private pool. A key packs the block index with a
+ * per-slot generation that is bumped on insert and on erase (odd = live), so a key of an
+ * erased element never resolves to its successor until the 8-bit generation wraps after
+ * 128 reuses of the same slot. Lookups only touch the generation array, never the pool lock.
+ *
+ * @copyright
+ * No license. See README.md for details.
+ */
+namespace mem {
+/**
+ * @class SlotMap
+ * @brief O(1) insert/erase/lookup keyed by (index, generation), dense iteration via the pool's occupancy bitmap.
+ *
+ * Elements never move once inserted, so pointers returned by find() stay valid until the
+ * element is erased.
+ *
+ * @tparam T Element type.
+ * @note Like standard containers, a SlotMap is not safe for concurrent mutation.
+ */
+template < class T > class SlotMap final {
+public:
+  using key_type = std::uint32_t;
+
+  static constexpr unsigned    kIndexBits = 24;
+  static constexpr std::size_t kMaxSize   = std::size_t{ 1 } << kIndexBits;
+
+  /**
+   * @brief Construct a slot map able to hold up to @p capacity elements.
+   * @throw std::invalid_argument if @p capacity is 0 or exceeds kMaxSize.
+   * @throw std::bad_alloc if the pool cannot be allocated.
+   */
+  explicit SlotMap( std::size_t capacity )
+      : pool_{ sizeof( T ), check_capacity( capacity ), std::max( alignof( T ), alignof( void * ) ) },
+        generations_( capacity, std::uint8_t{ 0 } ), size_{ 0 } {}
+
+  SlotMap( const SlotMap & )             = delete;
+  SlotMap & operator=( const SlotMap & ) = delete;
+
+  ~SlotMap() { clear(); }
+
+  /**
+   * @brief Construct an element in place.
+   * @return Key of the new element.
+   * @throw std::bad_alloc if the map is full.
+   */
+  template < class... Args > key_type emplace( Args &&... args ) {
+    void * block = pool_.allocate();
+    try {
+      ::new ( block ) T( std::forward< Args >( args )... );
+    } catch ( ... ) {
+      pool_.deallocate( block );
+      throw;
+    }
+    ++size_;
+    const std::size_t idx = slot_of( block );
+    return make_key( idx, ++generations_[idx] );
+  }
+
+  /// @copydoc emplace
+  key_type insert( T value ) { return emplace( std::move( value ) ); }
+
+  /// @return Element for @p key, or nullptr if it was erased or never existed.
+  T * find( key_type key ) noexcept {
+    const std::size_t  idx        = index_of_key( key );
+    const std::uint8_t generation = generation_of_key( key );
+    if ( idx >= generations_.size() || generations_[idx] != generation || ( generation & 1u ) == 0 ) {
+      return nullptr;
+    }
+    return static_cast< T * >( pool_.block_at( idx ) );
+  }
+
+  /// @copydoc find
+  const T * find( key_type key ) const noexcept { return const_cast< SlotMap * >( this )->find( key ); }
+
+  /// @return true if @p key refers to a live element.
+  bool contains( key_type key ) const noexcept { return find( key ) != nullptr; }
+
+  /**
+   * @brief Destroy the element for @p key and retire the key.
+   * @return true if an element was erased.
+   */
+  bool erase( key_type key ) {
+    T * value = find( key );
+    if ( !value ) {
+      return false;
+    }
+    value->~T();
+    ++generations_[index_of_key( key )];
+    pool_.deallocate( value );
+    --size_;
+    return true;
+  }
+
+  /**
+   * @brief Visit live elements in slot order.
+   * @param f Callable invoked as `f( key_type key, T & value )`; it must not insert or erase.
+   */
+  template < class F > void for_each( F && f ) {
+    pool_.for_each_allocated(
+        [&]( std::size_t idx, void * block ) { f( make_key( idx, generations_[idx] ), *static_cast< T * >( block ) ); } );
+  }
+
+  /// Destroy all elements without allocating. Keys handed out before the call become stale.
+  void clear() {
+    // The pool lock is held during the visit, so the emptied blocks are chained through their
+    // first bytes and freed afterwards in one deallocate_chain()
+    void * chain = nullptr;
+    pool_.for_each_allocated( [&]( std::size_t idx, void * block ) {
+      static_cast< T * >( block )->~T();
+      ++generations_[idx];
+      *static_cast< void ** >( block ) = chain;
+      chain                            = block;
+    } );
+    pool_.deallocate_chain( chain );
+    size_ = 0;
+  }
+
+  /// @return Number of live elements.
+  std::size_t size() const noexcept { return size_; }
+
+  /// @return true if the map holds no elements.
+  bool empty() const noexcept { return size_ == 0; }
+
+  /// @return Maximum number of elements.
+  std::size_t capacity() const noexcept { return generations_.size(); }
+
+private:
+  static constexpr key_type kIndexMask = ( key_type{ 1 } << kIndexBits ) - 1;
+
+  BlockAllocator              pool_;
+  std::vector< std::uint8_t > generations_; // bumped on insert and erase; odd while the slot is live
+  std::size_t                 size_;
+
+  static std::size_t check_capacity( std::size_t capacity ) {
+    if ( capacity > kMaxSize ) {
+      throw std::invalid_argument( "SlotMap: capacity exceeds key index range" );
+    }
+    return capacity;
+  }
+
+  std::size_t slot_of( const void * block ) const noexcept {
+    return static_cast< std::size_t >( static_cast< const std::byte * >( block ) -
+                                       static_cast< const std::byte * >( pool_.block_at( 0 ) ) ) /
+           pool_.stride();
+  }
+
+  static key_type make_key( std::size_t idx, std::uint8_t generation ) noexcept {
+    return static_cast< key_type >( ( key_type{ generation } << kIndexBits ) | static_cast< key_type >( idx ) );
+  }
+
+  static std::size_t index_of_key( key_type key ) noexcept { return key & kIndexMask; }
+
+  static std::uint8_t generation_of_key( key_type key ) noexcept { return static_cast< std::uint8_t >( key >> kIndexBits ); }
+};
+} // namespace mem
@@ -1,18 +1,95 @@
 #include "block_allocator.hpp"
+#include "memory_budget.hpp"
+#include "page_map.hpp"
+#include "page_pool.hpp"
 
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <map>
 #include <new>
+#include <ostream>
+#include <utility>
+
+#include <execinfo.h>
+#include <iostream>
+
+#if defined( __SSE2__ )
+  #include <emmintrin.h>
+#endif
+
+#include <sys/mman.h>
+#include <unistd.h>
 
 namespace mem {
 
-static void * allocate_aligned( std::size_t alignment, std::size_t size ) {
-  void * p  = nullptr;
-  int    rc = posix_memalign( &p, alignment, size );
-  if ( rc != 0 ) {
-    return nullptr;
+struct BlockAllocator::AsyncBuffer {
+  static constexpr std::size_t kCapacity = 256;
+
+  std::atomic< std::size_t > head{ 0 };          // next slot to consume (drain side)
+  std::atomic< std::size_t > tail{ 0 };          // next slot to fill (owning thread)
+  std::atomic< bool >        orphaned{ false };  // set when the allocator is destroyed
+  void *                     slots[kCapacity] = {};
+
+  bool push( void * p ) noexcept {
+    const std::size_t t = tail.load( std::memory_order_relaxed );
+    if ( t - head.load( std::memory_order_acquire ) == kCapacity ) {
+      return false;
+    }
+    slots[t % kCapacity] = p;
+    tail.store( t + 1, std::memory_order_release );
+    return true;
+  }
+
+  template < class F > std::size_t consume( F && f ) {
+    const std::size_t h = head.load( std::memory_order_relaxed );
+    const std::size_t t = tail.load( std::memory_order_acquire );
+    for ( std::size_t i = h; i != t; ++i ) {
+      f( slots[i % kCapacity] );
+    }
+    head.store( t, std::memory_order_release );
+    return t - h;
+  }
+};
+
+static std::atomic< std::uint64_t > next_allocator_id{ 1 };
+
+// Kept out of line so the skipped frame is always this one
+[[gnu::noinline]] static std::size_t capture_stack( void ** frames, std::size_t max_frames ) noexcept {
+  void *    raw[64];
+  const int depth = backtrace( raw, static_cast< int >( std::min< std::size_t >( max_frames + 1, 64 ) ) );
+  if ( depth <= 1 ) {
+    return 0;
+  }
+  std::copy( raw + 1, raw + depth, frames );
+  return static_cast< std::size_t >( depth - 1 );
+}
+
+static std::size_t page_size() noexcept {
+  static const std::size_t size = static_cast< std::size_t >( sysconf( _SC_PAGESIZE ) );
+  return size;
+}
+
+// LSD radix sort on 8-bit digits; only as many passes as max_key needs
+static void radix_sort( std::vector< std::size_t > & keys, std::size_t max_key ) {
+  if ( keys.size() < 64 ) {
+    std::sort( keys.begin(), keys.end() );
+    return;
+  }
+  std::vector< std::size_t > scratch( keys.size() );
+  for ( unsigned shift = 0; shift < 64 && ( max_key >> shift ) != 0; shift += 8 ) {
+    std::size_t counts[257] = {};
+    for ( std::size_t k : keys ) {
+      ++counts[( ( k >> shift ) & 0xFF ) + 1];
+    }
+    for ( std::size_t d = 0; d < 256; ++d ) {
+      counts[d + 1] += counts[d];
+    }
+    for ( std::size_t k : keys ) {
+      scratch[counts[( k >> shift ) & 0xFF]++] = k;
+    }
+    keys.swap( scratch );
   }
-  return p;
 }
 
 std::size_t BlockAllocator::round_up( std::size_t value, std::size_t align ) noexcept {
@@ -20,9 +97,16 @@ std::size_t BlockAllocator::round_up( std::size_t value, std::size_t align ) noe
   return ( value + mask ) & ~mask;
 }
 
-BlockAllocator::BlockAllocator( std::size_t block_size, std::size_t block_count, std::size_t alignment )
-    : block_size_{ block_size }, block_count_{ block_count }, alignment_{ alignment }, stride_{ 0 }, region_{ nullptr },
-      free_list_{ nullptr }, free_count_{ 0 }, occupancy_( block_count, static_cast< std::uint8_t >( 0 ) ) {
+BlockAllocator::BlockAllocator( std::size_t block_size, std::size_t block_count, std::size_t alignment,
+                                const BlockAllocatorOptions & options )
+    : block_size_{ block_size }, block_count_{ block_count }, alignment_{ alignment }, stride_{ 0 },
+      max_blocks_{ std::max( block_count, options.reserve_blocks ) }, region_{ nullptr }, map_base_{ nullptr }, map_bytes_{ 0 },
+      committed_bytes_{ 0 }, page_pool_{ options.page_pool }, budget_{ options.budget }, budget_id_{ 0 }, free_list_{ nullptr },
+      long_free_list_{ nullptr }, long_cur_{ 0 }, long_end_{ 0 }, free_count_{ 0 }, bump_{ 0 }, touched_{ 0 }, parked_count_{ 0 },
+      parked_hint_{ 0 }, stream_span_{ 0 }, snapshot_active_{ false }, restoring_{ false }, leak_policy_{ options.leak_policy },
+      exhaustion_retries_{ options.exhaustion_retries }, next_handler_id_{ 1 }, has_handlers_{ false }, handling_thread_{},
+      epoch_{ 0 }, tagged_{ false }, sample_interval_{ 0 }, sample_countdown_{ 0 },
+      id_{ next_allocator_id.fetch_add( 1, std::memory_order_relaxed ) }, pending_frees_{ 0 }, reclaimer_stop_{ false } {
   if ( block_size_ == 0 || block_count_ == 0 ) {
     throw std::invalid_argument( "BlockAllocator: block_size and block_count must be > 0" );
   }
@@ -34,30 +118,123 @@ BlockAllocator::BlockAllocator( std::size_t block_size, std::size_t block_count,
   const std::size_t min_stride = std::max< std::size_t >( block_size_, sizeof( FreeNode ) );
   stride_                      = round_up( min_stride, alignment_ );
 
-  // Prevent overflow in total size calculation
-  if ( stride_ > static_cast< std::size_t >( -1 ) / block_count_ ) {
+  // Prevent overflow in total size calculation (including page rounding and alignment slack)
+  const std::size_t slack = std::max( alignment_, page_size() ) * 2;
+  if ( stride_ > ( static_cast< std::size_t >( -1 ) - slack ) / max_blocks_ ) {
     throw std::invalid_argument( "BlockAllocator: size overflow" );
   }
-  const std::size_t total_size = stride_ * block_count_;
+  const std::size_t reserved_bytes = round_up( stride_ * max_blocks_, page_size() );
+  const bool        growable       = max_blocks_ > block_count_;
+  const std::size_t initial_bytes  = growable ? round_up( stride_ * block_count_, page_size() ) : reserved_bytes;
+  if ( budget_ && !budget_->charge( initial_bytes ) ) {
+    // Ask only for what is missing under the hard limit, not the whole charge
+    const std::size_t headroom = budget_->hard_limit() - std::min( budget_->used(), budget_->hard_limit() );
+    budget_->reclaim( initial_bytes - std::min( initial_bytes, headroom ) );
+    if ( !budget_->charge( initial_bytes ) ) {
+      throw std::bad_alloc();
+    }
+  }
 
-  // posix_memalign requires alignment to be a multiple of sizeof(void*) and a power of two (already validated)
-  region_ = static_cast< std::byte * >( allocate_aligned( alignment_, total_size ) );
-  if ( !region_ ) {
+  // mmap only guarantees page alignment; over-reserve so the region start can be aligned up
+  const std::size_t extra = alignment_ > page_size() ? alignment_ : 0;
+  map_bytes_              = reserved_bytes + extra;
+  const int prot          = growable ? PROT_NONE : PROT_READ | PROT_WRITE;
+  const int flags         = MAP_PRIVATE | MAP_ANONYMOUS | ( growable ? MAP_NORESERVE : 0 );
+  void *    base          = mmap( nullptr, map_bytes_, prot, flags, -1, 0 );
+  if ( base == MAP_FAILED ) {
+    if ( budget_ ) {
+      budget_->uncharge( initial_bytes );
+    }
     throw std::bad_alloc();
   }
+  map_base_ = static_cast< std::byte * >( base );
+  region_   = reinterpret_cast< std::byte * >( round_up( reinterpret_cast< std::uintptr_t >( map_base_ ), alignment_ ) );
 
-  // Build the free list by walking the blocks
-  free_list_ = nullptr;
-  for ( std::size_t i = 0; i < block_count_; ++i ) {
-    auto * node = reinterpret_cast< FreeNode * >( region_ + i * stride_ );
-    node->next  = free_list_;
-    free_list_  = node;
+  if ( growable ) {
+    // Commit only the pages backing the initial blocks; the rest stays PROT_NONE until needed
+    if ( mprotect( region_, initial_bytes, PROT_READ | PROT_WRITE ) != 0 ) {
+      munmap( map_base_, map_bytes_ );
+      if ( budget_ ) {
+        budget_->uncharge( initial_bytes );
+      }
+      throw std::bad_alloc();
+    }
   }
+  committed_bytes_ = initial_bytes;
+
+  // Blocks are carved lazily from the bump cursor, so untouched pages are never faulted in
+  occupancy_.assign( ( max_blocks_ + 63 ) / 64, std::uint64_t{ 0 } );
+  dirty_.reset( new std::atomic< std::uint64_t >[occupancy_.size()]() );
+  parked_.assign( occupancy_.size(), std::uint64_t{ 0 } );
+  long_side_.assign( occupancy_.size(), std::uint64_t{ 0 } );
   free_count_ = block_count_;
+
+  // Committed pages only: the map grows with what the pool uses, not with what it reserves
+  try {
+    if ( !PageMap::insert( region_, committed_bytes_, this ) ) {
+      throw std::runtime_error( "BlockAllocator: region lies outside the page map's address range" );
+    }
+  } catch ( ... ) {
+    munmap( map_base_, map_bytes_ );
+    if ( budget_ ) {
+      budget_->uncharge( committed_bytes_ );
+    }
+    throw;
+  }
+
+  if ( budget_ ) {
+    // Registered last: nothing after this may throw, or the destructor would not unregister it
+    try {
+      budget_id_ = budget_->add_reclaimer( [this]( std::size_t bytes ) { return decommit_free_tail( bytes ); } );
+    } catch ( ... ) {
+      PageMap::erase( region_, committed_bytes_ );
+      munmap( map_base_, map_bytes_ );
+      budget_->uncharge( committed_bytes_ );
+      throw;
+    }
+  }
 }
 
 BlockAllocator::~BlockAllocator() noexcept {
-  std::free( region_ );
+  if ( budget_ ) {
+    // Waits out a reclaim pass that may be running our callback
+    try {
+      budget_->remove_reclaimer( budget_id_ );
+    } catch ( const std::exception & ) {
+      // Only a failed mutex lock can throw here
+    }
+  }
+  stop_reclaimer();
+  try {
+    drain();
+  } catch ( const std::exception & ) {
+    // Invalid deferred frees cannot be reported to anyone at this point
+  }
+  for ( const auto & buffer : async_buffers_ ) {
+    buffer->orphaned.store( true, std::memory_order_release );
+  }
+
+  const LeakPolicy policy = leak_policy_.load( std::memory_order_relaxed );
+  if ( policy != LeakPolicy::Ignore && allocated_blocks() != 0 ) {
+    try {
+      report_leaks( std::cerr );
+    } catch ( const std::exception & ) {
+      // Best effort only
+    }
+#ifndef NDEBUG
+    if ( policy == LeakPolicy::AbortInDebug ) {
+      std::abort();
+    }
+#endif
+  }
+
+  // Stop filling pages before the region goes away, and unregister it before another pool can map the same range
+  lazy_restore_.reset();
+  PageMap::erase( region_, committed_bytes_ );
+  munmap( map_base_, map_bytes_ );
+  if ( budget_ ) {
+    budget_->uncharge( committed_bytes_ );
+  }
   region_     = nullptr;
   free_list_  = nullptr;
   free_count_ = 0;
@@ -65,22 +242,123 @@ BlockAllocator::~BlockAllocator() noexcept {
 }
 
 void * BlockAllocator::allocate() {
-  std::lock_guard< std::mutex > lock( mtx_ );
-  if ( !free_list_ ) {
+  SampledStack stack;
+  const bool   sampled = sample_if_due( stack );
+
+  std::unique_lock< std::mutex > lock( mtx_ );
+  if ( available_unlocked( 0 ) == 0 && !grow_locked( lock, 1 ) && !recover_locked( lock, 0, 1 ) ) {
     throw std::bad_alloc();
   }
+  void * p = pop_unlocked( 0 );
+  if ( sampled ) {
+    record_sample_unlocked( p, stack );
+  }
+  return p;
+}
 
-  // Pop from free list
-  FreeNode * node = free_list_;
-  free_list_      = free_list_->next;
-  --free_count_;
+void * BlockAllocator::allocate( Lifetime hint ) {
+  SampledStack stack;
+  const bool   sampled = sample_if_due( stack );
+
+  std::unique_lock< std::mutex > lock( mtx_ );
+  if ( available_unlocked( 0 ) == 0 && !grow_locked( lock, 1 ) && !recover_locked( lock, 0, 1 ) ) {
+    throw std::bad_alloc();
+  }
+  void * p = pop_hinted_unlocked( hint );
+  if ( sampled ) {
+    record_sample_unlocked( p, stack );
+  }
+  return p;
+}
 
-  // Compute block index and mark as allocated
-  const std::size_t idx =
-      ( reinterpret_cast< std::uintptr_t >( node ) - reinterpret_cast< std::uintptr_t >( region_ ) ) / stride_;
-  occupancy_[idx] = 1;
+void * BlockAllocator::allocate( BlockTag tag ) {
+  SampledStack stack;
+  const bool   sampled = sample_if_due( stack );
 
-  return static_cast< void * >( node );
+  std::unique_lock< std::mutex > lock( mtx_ );
+  if ( tag != BlockTag::None && tags_.empty() ) {
+    tags_.assign( max_blocks_, 0 );
+    queued_.reset( new std::atomic< std::uint64_t >[( max_blocks_ + 63 ) / 64]() );
+    tagged_.store( true, std::memory_order_release );
+  }
+  if ( available_unlocked( 0 ) == 0 && !grow_locked( lock, 1 ) && !recover_locked( lock, 0, 1 ) ) {
+    throw std::bad_alloc();
+  }
+  void * p = pop_unlocked( 0 );
+  if ( tag != BlockTag::None ) {
+    tags_[index_of_node( p )] = static_cast< std::uint16_t >( tag );
+  }
+  if ( sampled ) {
+    record_sample_unlocked( p, stack );
+  }
+  return p;
+}
+
+void * BlockAllocator::allocate_stream( std::uint64_t key ) {
+  SampledStack stack;
+  const bool   sampled = sample_if_due( stack );
+
+  std::unique_lock< std::mutex > lock( mtx_ );
+  const std::size_t              stream = streams_.empty() ? 0 : static_cast< std::size_t >( key % streams_.size() );
+  // Without streams this is allocate(), growth included; a stream's sub-range never grows
+  if ( available_unlocked( stream ) == 0 && ( !streams_.empty() || !grow_locked( lock, 1 ) ) &&
+       !recover_locked( lock, stream, 1 ) ) {
+    throw std::bad_alloc();
+  }
+  void * p = pop_unlocked( stream );
+  if ( sampled ) {
+    record_sample_unlocked( p, stack );
+  }
+  return p;
+}
+
+bool BlockAllocator::allocate_all( void ** out, std::size_t k, std::size_t * available ) {
+  if ( !out && k > 0 ) {
+    throw std::invalid_argument( "BlockAllocator::allocate_all: out must not be nullptr" );
+  }
+  std::unique_lock< std::mutex > lock( mtx_ );
+  if ( available_unlocked( 0 ) < k && !grow_locked( lock, k ) && k <= ( streams_.empty() ? max_blocks_ : streams_[0].count ) ) {
+    recover_locked( lock, 0, k );
+  }
+  const std::size_t free = available_unlocked( 0 );
+  if ( available ) {
+    *available = free;
+  }
+  if ( free < k ) {
+    return false;
+  }
+  for ( std::size_t i = 0; i < k; ++i ) {
+    out[i] = pop_unlocked( 0 );
+  }
+  return true;
+}
+
+bool BlockAllocator::allocate_all_for( void ** out, std::size_t k, std::chrono::nanoseconds timeout, std::size_t * available ) {
+  if ( !out && k > 0 ) {
+    throw std::invalid_argument( "BlockAllocator::allocate_all_for: out must not be nullptr" );
+  }
+  std::unique_lock< std::mutex > lock( mtx_ );
+  const std::size_t              limit = streams_.empty() ? max_blocks_ : streams_[0].count;
+  if ( available_unlocked( 0 ) < k && !grow_locked( lock, k ) && k <= limit ) {
+    recover_locked( lock, 0, k );
+  }
+  if ( available_unlocked( 0 ) < k && k <= limit ) {
+    // Register the request so deallocate() only wakes us once it can be satisfied
+    auto it = wait_ks_.insert( k );
+    cv_.wait_for( lock, timeout, [&] { return available_unlocked( 0 ) >= k; } );
+    wait_ks_.erase( it );
+  }
+  const std::size_t free = available_unlocked( 0 );
+  if ( available ) {
+    *available = free;
+  }
+  if ( free < k ) {
+    return false;
+  }
+  for ( std::size_t i = 0; i < k; ++i ) {
+    out[i] = pop_unlocked( 0 );
+  }
+  return true;
 }
 
 void BlockAllocator::deallocate( void * p ) {
@@ -94,16 +372,238 @@ void BlockAllocator::deallocate( void * p ) {
   }
 
   const std::size_t idx = index_from_ptr_unlocked( p );
-  if ( occupancy_[idx] == 0 ) {
+  if ( !test_bit( occupancy_, idx ) ) {
     throw std::runtime_error( "BlockAllocator::deallocate: double free or corruption detected" );
   }
 
-  // Push back onto free list
-  auto * node = reinterpret_cast< FreeNode * >( p );
-  node->next  = free_list_;
-  free_list_  = node;
-  --occupancy_[idx]; // becomes 0
-  ++free_count_;
+  push_unlocked( idx );
+  notify_waiters_unlocked();
+}
+
+void BlockAllocator::deallocate_async( void * p ) {
+  if ( !p ) {
+    return;
+  }
+  // region_, stride_ and the reservation never change, so this check needs no lock
+  const std::size_t off =
+      static_cast< std::size_t >( reinterpret_cast< std::uintptr_t >( p ) - reinterpret_cast< std::uintptr_t >( region_ ) );
+  if ( off >= stride_ * max_blocks_ || off % stride_ != 0 ) {
+    throw std::runtime_error( "BlockAllocator::deallocate_async: pointer does not belong to this allocator" );
+  }
+
+  AsyncBuffer & buffer = thread_buffer();
+  if ( tagged_.load( std::memory_order_acquire ) ) {
+    // Still tagged until drained: keep deallocate_all() from freeing it a second time
+    const std::size_t idx = off / stride_;
+    queued_[idx / 64].fetch_or( std::uint64_t{ 1 } << ( idx % 64 ), std::memory_order_relaxed );
+  }
+  pending_frees_.fetch_add( 1, std::memory_order_relaxed );
+  while ( !buffer.push( p ) ) {
+    // Back-pressure: flush our own buffer before queueing more
+    std::lock_guard< std::mutex > lock( async_mtx_ );
+    try {
+      drain_locked( &buffer );
+    } catch ( const std::runtime_error & ) {
+      // A stale double free in the buffer must not lose the block being queued now
+    }
+  }
+}
+
+std::size_t BlockAllocator::drain() {
+  std::lock_guard< std::mutex > lock( async_mtx_ );
+  return drain_locked( nullptr );
+}
+
+void BlockAllocator::start_reclaimer( std::chrono::milliseconds interval ) {
+  std::lock_guard< std::mutex > lock( reclaimer_mtx_ );
+  if ( reclaimer_.joinable() ) {
+    throw std::logic_error( "BlockAllocator::start_reclaimer: reclaimer already running" );
+  }
+  reclaimer_stop_ = false;
+  reclaimer_      = std::thread( [this, interval]() {
+    std::unique_lock< std::mutex > wait_lock( reclaimer_mtx_ );
+    while ( !reclaimer_stop_ ) {
+      reclaimer_cv_.wait_for( wait_lock, interval, [this] { return reclaimer_stop_; } );
+      wait_lock.unlock();
+      try {
+        drain();
+      } catch ( const std::exception & ) {
+        // Invalid blocks were dropped; keep reclaiming the rest
+      }
+      wait_lock.lock();
+    }
+  } );
+}
+
+void BlockAllocator::stop_reclaimer() noexcept {
+  std::thread worker;
+  {
+    std::lock_guard< std::mutex > lock( reclaimer_mtx_ );
+    reclaimer_stop_ = true;
+    worker          = std::move( reclaimer_ );
+  }
+  reclaimer_cv_.notify_all();
+  if ( worker.joinable() ) {
+    worker.join();
+  }
+}
+
+void BlockAllocator::deallocate_batch( void * const * ptrs, std::size_t n ) {
+  if ( !ptrs && n > 0 ) {
+    throw std::invalid_argument( "BlockAllocator::deallocate_batch: ptrs must not be nullptr" );
+  }
+
+  // Range and stride checks against the (immutable) reservation, outside the lock. The loop
+  // is branch-free so the compiler can vectorise it; nullptr entries are skipped like deallocate().
+  std::vector< std::size_t > idx;
+  idx.reserve( n );
+  const auto        base    = reinterpret_cast< std::uintptr_t >( region_ );
+  const std::size_t limit   = stride_ * max_blocks_;
+  const bool        pow2    = is_power_of_two( stride_ );
+  const std::size_t mask    = stride_ - 1;
+  const unsigned    shift   = pow2 ? static_cast< unsigned >( __builtin_ctzll( stride_ ) ) : 0;
+  std::uintptr_t    invalid = 0;
+  for ( std::size_t i = 0; i < n; ++i ) {
+    if ( ptrs[i] ) {
+      idx.push_back( reinterpret_cast< std::uintptr_t >( ptrs[i] ) - base );
+    }
+  }
+  if ( pow2 ) {
+    for ( std::size_t & off : idx ) {
+      invalid |= static_cast< std::uintptr_t >( off >= limit ) | ( off & mask );
+      off >>= shift;
+    }
+  }
+  else {
+    for ( std::size_t & off : idx ) {
+      invalid |= static_cast< std::uintptr_t >( off >= limit ) | ( off % stride_ );
+      off /= stride_;
+    }
+  }
+  if ( invalid != 0 ) {
+    throw std::runtime_error( "BlockAllocator::deallocate_batch: pointer does not belong to this allocator" );
+  }
+  if ( idx.empty() ) {
+    return;
+  }
+  radix_sort( idx, max_blocks_ - 1 );
+
+  std::lock_guard< std::mutex > lock( mtx_ );
+
+  // Validate the whole batch before touching anything, so a bad batch frees nothing
+  if ( idx.back() >= block_count_ ) {
+    throw std::runtime_error( "BlockAllocator::deallocate_batch: pointer does not belong to this allocator" );
+  }
+  bool bad = false;
+  for ( std::size_t i = 0; i < idx.size(); ++i ) {
+    bad |= !test_bit( occupancy_, idx[i] ) || ( i > 0 && idx[i] == idx[i - 1] );
+  }
+  if ( bad ) {
+    throw std::runtime_error( "BlockAllocator::deallocate_batch: double free or corruption detected" );
+  }
+
+  // Push highest address first so the batch ends up address-ordered at the list head
+  for ( std::size_t i = idx.size(); i-- > 0; ) {
+    push_unlocked( idx[i] );
+  }
+  notify_waiters_unlocked();
+}
+
+void BlockAllocator::deallocate_chain( void * head ) {
+  if ( !head ) {
+    return;
+  }
+  auto next_of = []( void * block ) { return *static_cast< void ** >( block ); };
+
+  std::lock_guard< std::mutex > lock( mtx_ );
+
+  // Validate the whole chain before freeing anything. Occupancy bits are cleared as blocks are
+  // visited, so a block met twice fails the check and a cycle cannot loop forever.
+  const char * error   = nullptr;
+  std::size_t  visited = 0;
+  for ( void * p = head; p; p = next_of( p ) ) {
+    if ( !is_from_region_unlocked( p ) ) {
+      error = "BlockAllocator::deallocate_chain: pointer does not belong to this allocator";
+      break;
+    }
+    const std::size_t idx = index_of_node( p );
+    if ( !test_bit( occupancy_, idx ) ) {
+      error = "BlockAllocator::deallocate_chain: double free or corruption detected";
+      break;
+    }
+    clear_bit( occupancy_, idx );
+    ++visited;
+  }
+  void * p = head;
+  for ( std::size_t i = 0; i < visited; ++i, p = next_of( p ) ) {
+    set_bit( occupancy_, index_of_node( p ) );
+  }
+  if ( error ) {
+    throw std::runtime_error( error );
+  }
+
+  for ( p = head; p; ) {
+    void * next = next_of( p ); // push_unlocked() overwrites the link
+    push_unlocked( index_of_node( p ) );
+    p = next;
+  }
+  notify_waiters_unlocked();
+}
+
+std::size_t BlockAllocator::deallocate_all( BlockTag tag ) {
+  const auto                    want = static_cast< std::uint16_t >( tag );
+  std::lock_guard< std::mutex > lock( mtx_ );
+  if ( want == 0 || tags_.empty() ) {
+    return 0;
+  }
+
+  // Only allocated blocks carry a tag, so a match needs no occupancy check
+  std::vector< std::size_t > idx;
+  std::size_t                i = 0;
+#if defined( __SSE2__ )
+  const __m128i key = _mm_set1_epi16( static_cast< short >( want ) );
+  for ( ; i + 8 <= block_count_; i += 8 ) {
+    const __m128i lanes = _mm_loadu_si128( reinterpret_cast< const __m128i * >( tags_.data() + i ) );
+    auto          mask  = static_cast< unsigned >( _mm_movemask_epi8( _mm_cmpeq_epi16( lanes, key ) ) );
+    while ( mask != 0 ) {
+      idx.push_back( i + static_cast< std::size_t >( __builtin_ctz( mask ) ) / 2 );
+      mask &= mask - 1; // two mask bits per 16-bit lane
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for ( ; i < block_count_; ++i ) {
+    if ( tags_[i] == want ) {
+      idx.push_back( i );
+    }
+  }
+
+  // Push highest address first so the batch ends up address-ordered at the list head
+  std::size_t freed = 0;
+  for ( std::size_t k = idx.size(); k-- > 0; ) {
+    if ( ( queued_[idx[k] / 64].load( std::memory_order_relaxed ) >> ( idx[k] % 64 ) ) & 1 ) {
+      continue; // an async buffer holds it; drain frees it
+    }
+    push_unlocked( idx[k] );
+    ++freed;
+  }
+  notify_waiters_unlocked();
+  return freed;
+}
+
+BlockTag BlockAllocator::tag_of( std::size_t idx ) const noexcept {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  return idx < tags_.size() ? static_cast< BlockTag >( tags_[idx] ) : BlockTag::None;
+}
+
+std::size_t BlockAllocator::block_count() const noexcept {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  return block_count_;
+}
+
+std::size_t BlockAllocator::capacity_bytes() const noexcept {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  return stride_ * block_count_;
 }
 
 std::size_t BlockAllocator::free_blocks() const noexcept {
@@ -111,6 +611,856 @@ std::size_t BlockAllocator::free_blocks() const noexcept {
   return free_count_;
 }
 
+void * BlockAllocator::allocate_zeroed() {
+  SampledStack stack;
+  const bool   sampled = sample_if_due( stack );
+
+  void * p          = nullptr;
+  bool   known_zero = false;
+  {
+    std::unique_lock< std::mutex > lock( mtx_ );
+    if ( available_unlocked( 0 ) == 0 && !grow_locked( lock, 1 ) && !recover_locked( lock, 0, 1 ) ) {
+      throw std::bad_alloc();
+    }
+    known_zero = streams_.empty() && ( ( bump_ < block_count_ && bump_ >= touched_ ) || parked_count_ > 0 );
+    p          = known_zero ? pop_zero_unlocked() : pop_unlocked( 0 );
+    if ( sampled ) {
+      record_sample_unlocked( p, stack );
+    }
+  }
+  if ( !known_zero ) {
+    clear_block( p, block_size_ );
+  }
+  return p;
+}
+
+std::size_t BlockAllocator::allocated_blocks() const noexcept {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  std::size_t                   count = 0;
+  for ( std::uint64_t word : occupancy_ ) {
+    count += static_cast< std::size_t >( __builtin_popcountll( word ) );
+  }
+  return count;
+}
+
+std::vector< std::size_t > BlockAllocator::allocated_indices( std::size_t max_count ) const {
+  std::vector< std::size_t > indices;
+  for_each_allocated( [&]( std::size_t idx, void * ) {
+    if ( indices.size() < max_count ) {
+      indices.push_back( idx );
+    }
+  } );
+  return indices;
+}
+
+void BlockAllocator::set_leak_policy( LeakPolicy policy ) noexcept { leak_policy_.store( policy, std::memory_order_relaxed ); }
+
+void BlockAllocator::report_leaks( std::ostream & os ) const {
+  constexpr std::size_t kMaxListed = 32;
+
+  const std::size_t leaked = allocated_blocks();
+  if ( leaked == 0 ) {
+    return;
+  }
+  os << "BlockAllocator: " << leaked << " block(s) of " << block_size_ << " bytes still allocated\n  indices:";
+  for ( std::size_t idx : allocated_indices( kMaxListed ) ) {
+    os << ' ' << idx;
+  }
+  if ( leaked > kMaxListed ) {
+    os << " ...";
+  }
+  os << '\n';
+  dump_sampled_sites( os );
+}
+
+void BlockAllocator::set_age_tracking( bool enabled ) {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  if ( !enabled ) {
+    alloc_epoch_ = std::vector< std::uint16_t >();
+    return;
+  }
+  if ( alloc_epoch_.empty() ) {
+    alloc_epoch_.assign( max_blocks_, epoch_.load( std::memory_order_relaxed ) );
+  }
+}
+
+std::array< std::size_t, BlockAllocator::kAgeBuckets > BlockAllocator::age_histogram() const {
+  std::array< std::size_t, kAgeBuckets > buckets{};
+  const std::uint16_t                    now = current_epoch();
+  for_each_allocated( [&]( std::size_t idx, void * ) {
+    if ( alloc_epoch_.empty() ) {
+      return;
+    }
+    const auto age = static_cast< std::uint16_t >( now - alloc_epoch_[idx] );
+    // Bucket = bit width of the age: 0 -> 0, 1 -> 1, 2..3 -> 2, 4..7 -> 3, ...
+    ++buckets[age == 0 ? 0 : static_cast< std::size_t >( 32 - __builtin_clz( age ) )];
+  } );
+  return buckets;
+}
+
+std::vector< BlockAge > BlockAllocator::oldest_blocks( std::size_t n ) const {
+  std::vector< BlockAge > ages;
+  const std::uint16_t     now = current_epoch();
+  for_each_allocated( [&]( std::size_t idx, void * ) {
+    if ( !alloc_epoch_.empty() ) {
+      ages.push_back( BlockAge{ idx, static_cast< std::uint16_t >( now - alloc_epoch_[idx] ) } );
+    }
+  } );
+  n = std::min( n, ages.size() );
+  std::partial_sort( ages.begin(), ages.begin() + static_cast< std::ptrdiff_t >( n ), ages.end(),
+                     []( const BlockAge & a, const BlockAge & b ) {
+                       return a.age > b.age || ( a.age == b.age && a.index < b.index );
+                     } );
+  ages.resize( n );
+  return ages;
+}
+
+void BlockAllocator::set_sample_interval( std::size_t interval ) {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  sample_interval_.store( interval, std::memory_order_relaxed );
+  sample_countdown_.store( interval, std::memory_order_relaxed );
+  if ( interval == 0 ) {
+    samples_.clear();
+  }
+}
+
+std::vector< SampledSite > BlockAllocator::sampled_sites() const {
+  std::map< std::vector< void * >, std::size_t > by_stack;
+  std::size_t                                    interval = 0;
+  {
+    std::lock_guard< std::mutex > lock( mtx_ );
+    interval = sample_interval_.load( std::memory_order_relaxed );
+    for ( const auto & entry : samples_ ) {
+      const SampledStack & stack = entry.second;
+      const auto           end   = stack.frames.begin() + static_cast< std::ptrdiff_t >( stack.depth );
+      ++by_stack[std::vector< void * >( stack.frames.begin(), end )];
+    }
+  }
+
+  std::vector< SampledSite > sites;
+  sites.reserve( by_stack.size() );
+  for ( auto & entry : by_stack ) {
+    sites.push_back( SampledSite{ entry.first, entry.second, entry.second * interval } );
+  }
+  std::stable_sort( sites.begin(), sites.end(),
+                    []( const SampledSite & a, const SampledSite & b ) { return a.sampled_blocks > b.sampled_blocks; } );
+  return sites;
+}
+
+void BlockAllocator::dump_sampled_sites( std::ostream & os ) const {
+  for ( const SampledSite & site : sampled_sites() ) {
+    os << site.sampled_blocks << " sampled live blocks (~" << site.estimated_blocks << " estimated)\n";
+    char ** symbols = backtrace_symbols( site.frames.data(), static_cast< int >( site.frames.size() ) );
+    for ( std::size_t i = 0; i < site.frames.size(); ++i ) {
+      os << "    #" << i << ' ';
+      if ( symbols ) {
+        os << symbols[i];
+      }
+      else {
+        os << site.frames[i];
+      }
+      os << '\n';
+    }
+    std::free( symbols );
+  }
+}
+
+std::size_t BlockAllocator::release_free_pages() {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  if ( !streams_.empty() || region_pinned_unlocked() ) {
+    return 0;
+  }
+
+  // Find page-aligned interiors of free runs among the carved blocks
+  const std::size_t                                    page = page_size();
+  std::vector< std::pair< std::size_t, std::size_t > > ranges;     // byte offsets [lo, hi) to release
+  std::vector< std::size_t >                           straddlers; // listed blocks cut by a range end
+  std::vector< std::uint64_t >                         unlisted( occupancy_.size(), std::uint64_t{ 0 } );
+  // The uncarved rest of the long-lived chunk is free but belongs to that chunk's cursor
+  auto releasable = [this]( std::size_t i ) { return !test_bit( occupancy_, i ) && ( i < long_cur_ || i >= long_end_ ); };
+  for ( std::size_t i = 0; i < bump_; ) {
+    if ( !releasable( i ) ) {
+      ++i;
+      continue;
+    }
+    std::size_t j = i;
+    while ( j < bump_ && releasable( j ) ) {
+      ++j;
+    }
+    const std::size_t lo = round_up( i * stride_, page );
+    const std::size_t hi = ( j * stride_ ) / page * page;
+    if ( lo < hi ) {
+      ranges.emplace_back( lo, hi );
+      // Blocks starting inside the range lose their embedded link; whole ones become parked
+      for ( std::size_t b = ( lo + stride_ - 1 ) / stride_; b * stride_ < hi; ++b ) {
+        if ( test_bit( parked_, b ) ) {
+          continue;
+        }
+        set_bit( unlisted, b );
+        if ( ( b + 1 ) * stride_ <= hi ) {
+          set_bit( parked_, b );
+          ++parked_count_;
+          parked_hint_ = std::min( parked_hint_, b / 64 );
+        }
+        else {
+          straddlers.push_back( b );
+        }
+      }
+    }
+    i = j;
+  }
+  if ( ranges.empty() ) {
+    return 0;
+  }
+
+  // Unlink affected blocks before their links are zeroed
+  for ( FreeNode ** head : { &free_list_, &long_free_list_ } ) {
+    for ( FreeNode ** link = head; *link; ) {
+      if ( test_bit( unlisted, index_of_node( *link ) ) ) {
+        *link = ( *link )->next;
+      }
+      else {
+        link = &( *link )->next;
+      }
+    }
+  }
+
+  std::size_t released = 0;
+  for ( const auto & range : ranges ) {
+    if ( madvise( region_ + range.first, range.second - range.first, MADV_DONTNEED ) == 0 ) {
+      released += range.second - range.first;
+    }
+    else {
+      // Parked blocks must read as zero either way
+      std::memset( region_ + range.first, 0, range.second - range.first );
+    }
+  }
+
+  // Blocks only partly inside a range stay on their free list with a fresh link
+  for ( std::size_t b : straddlers ) {
+    FreeNode *& head = test_bit( long_side_, b ) ? long_free_list_ : free_list_;
+    auto *      node = reinterpret_cast< FreeNode * >( region_ + b * stride_ );
+    node->next       = head;
+    head             = node;
+  }
+  return released;
+}
+
+std::size_t BlockAllocator::donate_free_slabs( std::size_t max_slabs ) {
+  if ( !page_pool_ || max_slabs == 0 ) {
+    return 0;
+  }
+  std::lock_guard< std::mutex > lock( mtx_ );
+  if ( !streams_.empty() || region_pinned_unlocked() ) {
+    return 0;
+  }
+
+  const std::size_t slab  = page_pool_->slab_bytes();
+  const std::size_t slabs = std::min( max_slabs, free_tail_bytes_unlocked() / slab );
+  if ( slabs == 0 ) {
+    return 0;
+  }
+  const std::size_t new_committed = committed_bytes_ - slabs * slab;
+  shrink_unlocked( new_committed );
+
+  for ( std::size_t i = 0; i < slabs; ++i ) {
+    std::byte * src   = region_ + new_committed + i * slab;
+    void *      moved = MAP_FAILED;
+#ifdef MREMAP_DONTUNMAP
+    // The source range stays mapped but empty, so the reservation has no hole another mmap could take.
+    // new_address is passed explicitly: recent kernels reject a garbage value even without MREMAP_FIXED.
+    moved = mremap( src, slab, slab, MREMAP_MAYMOVE | MREMAP_DONTUNMAP, nullptr );
+#endif
+    if ( moved != MAP_FAILED ) {
+      page_pool_->put( moved );
+    }
+    else {
+      madvise( src, slab, MADV_DONTNEED );
+    }
+  }
+  mprotect( region_ + new_committed, slabs * slab, PROT_NONE );
+  committed_bytes_ = new_committed;
+  if ( budget_ ) {
+    budget_->uncharge( slabs * slab );
+  }
+  return slabs;
+}
+
+std::size_t BlockAllocator::decommit_free_tail( std::size_t max_bytes ) {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  if ( !streams_.empty() || region_pinned_unlocked() ) {
+    return 0;
+  }
+  const std::size_t bytes = std::min( max_bytes, free_tail_bytes_unlocked() ) / page_size() * page_size();
+  if ( bytes == 0 ) {
+    return 0;
+  }
+  const std::size_t new_committed = committed_bytes_ - bytes;
+  shrink_unlocked( new_committed );
+  madvise( region_ + new_committed, bytes, MADV_DONTNEED );
+  mprotect( region_ + new_committed, bytes, PROT_NONE );
+  committed_bytes_ = new_committed;
+  if ( budget_ ) {
+    budget_->uncharge( bytes );
+  }
+  return bytes;
+}
+
+std::size_t BlockAllocator::index_of( const void * p ) const {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  return index_from_ptr_unlocked( p );
+}
+
+void BlockAllocator::mark_dirty( const void * p ) {
+  // region_, stride_ and the reservation never change, so this check needs no lock
+  const std::size_t off =
+      static_cast< std::size_t >( reinterpret_cast< std::uintptr_t >( p ) - reinterpret_cast< std::uintptr_t >( region_ ) );
+  if ( off >= stride_ * max_blocks_ || off % stride_ != 0 ) {
+    throw std::runtime_error( "BlockAllocator::mark_dirty: pointer does not belong to this allocator" );
+  }
+  const std::size_t idx = off / stride_;
+  // Release: a collector that sees the bit also sees the write it records
+  dirty_[idx / 64].fetch_or( std::uint64_t{ 1 } << ( idx % 64 ), std::memory_order_release );
+}
+
+std::vector< std::size_t > BlockAllocator::collect_dirty() {
+  std::vector< std::size_t > indices;
+  const std::size_t          words = ( max_blocks_ + 63 ) / 64;
+  for ( std::size_t w = 0; w < words; ++w ) {
+    if ( dirty_[w].load( std::memory_order_relaxed ) == 0 ) {
+      continue;
+    }
+    for ( std::uint64_t bits = dirty_[w].exchange( 0, std::memory_order_acquire ); bits != 0; bits &= bits - 1 ) {
+      indices.push_back( w * 64 + static_cast< std::size_t >( __builtin_ctzll( bits ) ) );
+    }
+  }
+  return indices;
+}
+
+bool BlockAllocator::is_allocated( std::size_t idx ) const noexcept {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  return idx < block_count_ && test_bit( occupancy_, idx );
+}
+
+void BlockAllocator::set_deterministic_streams( std::size_t streams ) {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  if ( free_count_ != block_count_ ) {
+    throw std::logic_error( "BlockAllocator::set_deterministic_streams: all blocks must be free" );
+  }
+  if ( streams > block_count_ ) {
+    throw std::invalid_argument( "BlockAllocator::set_deterministic_streams: more streams than blocks" );
+  }
+
+  streams_.clear();
+  free_list_      = nullptr;
+  long_free_list_ = nullptr;
+  long_cur_       = 0;
+  long_end_       = 0;
+  std::fill( parked_.begin(), parked_.end(), std::uint64_t{ 0 } );
+  std::fill( long_side_.begin(), long_side_.end(), std::uint64_t{ 0 } );
+  parked_count_ = 0;
+  parked_hint_  = 0;
+  if ( streams == 0 ) {
+    // Everything is free: carve from the bottom again
+    stream_span_ = 0;
+    bump_        = 0;
+    return;
+  }
+
+  // Split the pool into equal contiguous sub-ranges, the last one taking the remainder
+  bump_        = block_count_;
+  touched_     = block_count_;
+  stream_span_ = block_count_ / streams;
+  streams_.resize( streams );
+  for ( std::size_t s = 0; s < streams; ++s ) {
+    const std::size_t first = s * stream_span_;
+    const std::size_t count = ( s + 1 == streams ) ? block_count_ - first : stream_span_;
+    streams_[s]             = Stream{ build_list_unlocked( first, count ), count, count };
+  }
+}
+
+std::size_t BlockAllocator::deterministic_streams() const noexcept {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  return streams_.size();
+}
+
+void BlockAllocator::rebuild_free_list_unlocked() noexcept {
+  // Every block counts as carved; free ones are listed lowest address first
+  free_list_  = nullptr;
+  free_count_ = 0;
+  for ( std::size_t i = block_count_; i-- > 0; ) {
+    if ( !test_bit( occupancy_, i ) ) {
+      auto * node = reinterpret_cast< FreeNode * >( region_ + i * stride_ );
+      node->next  = free_list_;
+      free_list_  = node;
+      ++free_count_;
+    }
+  }
+  bump_    = block_count_;
+  touched_ = block_count_;
+}
+
+void BlockAllocator::park_free_blocks_unlocked() noexcept {
+  free_list_    = nullptr;
+  free_count_   = 0;
+  parked_count_ = 0;
+  parked_hint_  = 0;
+  for ( std::size_t w = 0; w < parked_.size(); ++w ) {
+    // Only blocks below block_count_ exist
+    const std::size_t first = w * 64;
+    std::uint64_t     live  = first >= block_count_ ? 0 : ~occupancy_[w];
+    if ( first < block_count_ && block_count_ - first < 64 ) {
+      live &= ( std::uint64_t{ 1 } << ( block_count_ - first ) ) - 1;
+    }
+    parked_[w] = live;
+    parked_count_ += static_cast< std::size_t >( __builtin_popcountll( live ) );
+  }
+  free_count_ = parked_count_;
+  bump_       = block_count_;
+  touched_    = block_count_;
+}
+
+BlockAllocator::FreeNode * BlockAllocator::build_list_unlocked( std::size_t first, std::size_t count ) noexcept {
+  // Thread blocks so that the lowest address is popped first
+  FreeNode * head = nullptr;
+  for ( std::size_t i = first + count; i-- > first; ) {
+    auto * node = reinterpret_cast< FreeNode * >( region_ + i * stride_ );
+    node->next  = head;
+    head        = node;
+  }
+  return head;
+}
+
+std::size_t BlockAllocator::available_unlocked( std::size_t stream ) const noexcept {
+  return streams_.empty() ? free_count_ : streams_[stream].free;
+}
+
+void * BlockAllocator::pop_unlocked( std::size_t stream ) noexcept {
+  std::size_t idx = 0;
+  if ( !streams_.empty() ) {
+    Stream & s = streams_[stream];
+    idx        = index_of_node( s.head );
+    s.head     = s.head->next;
+    --s.free;
+  }
+  else if ( free_list_ ) {
+    // Pop from free list
+    idx        = index_of_node( free_list_ );
+    free_list_ = free_list_->next;
+  }
+  else if ( bump_ < block_count_ ) {
+    // Free list exhausted: carve the next never-used block
+    idx = carve_unlocked();
+  }
+  else if ( parked_count_ > 0 ) {
+    idx = unpark_unlocked();
+  }
+  else if ( long_cur_ < long_end_ ) {
+    // Short-lived side exhausted: borrow from the long-lived side
+    idx = long_cur_++;
+  }
+  else {
+    idx             = index_of_node( long_free_list_ );
+    long_free_list_ = long_free_list_->next;
+  }
+  return claim_unlocked( idx );
+}
+
+void * BlockAllocator::pop_hinted_unlocked( Lifetime hint ) noexcept {
+  if ( hint != Lifetime::Long || !streams_.empty() ) {
+    return pop_unlocked( 0 );
+  }
+
+  std::size_t idx = 0;
+  if ( long_free_list_ ) {
+    idx             = index_of_node( long_free_list_ );
+    long_free_list_ = long_free_list_->next;
+  }
+  else if ( long_cur_ < long_end_ || reserve_long_chunk_unlocked() ) {
+    idx = long_cur_++;
+    set_bit( long_side_, idx );
+  }
+  else {
+    // Long-lived side exhausted: fall back to the shared free list
+    return pop_unlocked( 0 );
+  }
+  return claim_unlocked( idx );
+}
+
+bool BlockAllocator::reserve_long_chunk_unlocked() noexcept {
+  if ( bump_ == block_count_ ) {
+    return false;
+  }
+  // Long-lived blocks are carved in page-group sized runs so they share pages with each other only
+  const std::size_t chunk = std::min( std::max< std::size_t >( 1, kLongChunkBytes / stride_ ), block_count_ - bump_ );
+  long_cur_               = bump_;
+  long_end_               = bump_ + chunk;
+  bump_ += chunk;
+  touched_ = std::max( touched_, bump_ );
+  return true;
+}
+
+void * BlockAllocator::pop_zero_unlocked() noexcept {
+  return claim_unlocked( ( bump_ < block_count_ && bump_ >= touched_ ) ? carve_unlocked() : unpark_unlocked() );
+}
+
+std::size_t BlockAllocator::carve_unlocked() noexcept {
+  const std::size_t idx = bump_++;
+  touched_              = std::max( touched_, bump_ );
+  return idx;
+}
+
+std::size_t BlockAllocator::unpark_unlocked() noexcept {
+  // parked_hint_ never points past the lowest parked word
+  std::size_t w = parked_hint_;
+  while ( parked_[w] == 0 ) {
+    ++w;
+  }
+  parked_hint_          = w;
+  const std::size_t idx = w * 64 + static_cast< std::size_t >( __builtin_ctzll( parked_[w] ) );
+  clear_bit( parked_, idx );
+  --parked_count_;
+  return idx;
+}
+
+void * BlockAllocator::claim_unlocked( std::size_t idx ) noexcept {
+  // Mark as allocated
+  set_bit( occupancy_, idx );
+  --free_count_;
+  if ( !alloc_epoch_.empty() ) {
+    alloc_epoch_[idx] = epoch_.load( std::memory_order_relaxed );
+  }
+  return region_ + idx * stride_;
+}
+
+void BlockAllocator::push_unlocked( std::size_t idx ) noexcept {
+  FreeNode ** head = test_bit( long_side_, idx ) ? &long_free_list_ : &free_list_;
+  if ( !streams_.empty() ) {
+    // The last sub-range absorbs the remainder blocks
+    Stream & s = streams_[std::min( idx / stream_span_, streams_.size() - 1 )];
+    head       = &s.head;
+    ++s.free;
+  }
+
+  // Push back onto free list
+  auto * node = reinterpret_cast< FreeNode * >( region_ + idx * stride_ );
+  node->next  = *head;
+  *head       = node;
+  clear_bit( occupancy_, idx );
+  ++free_count_;
+  if ( !tags_.empty() ) {
+    tags_[idx] = 0;
+  }
+  if ( !samples_.empty() ) {
+    samples_.erase( idx );
+  }
+}
+
+bool BlockAllocator::grow_unlocked( std::size_t need ) noexcept {
+  // Growth appends to the carve range, which deterministic sub-ranges do not cover
+  if ( !streams_.empty() || block_count_ == max_blocks_ || need > free_count_ + ( max_blocks_ - block_count_ ) ) {
+    return false;
+  }
+
+  // At least double the committed size to amortise mprotect calls, capped by the reservation
+  const std::size_t reserved_bytes = round_up( stride_ * max_blocks_, page_size() );
+  const std::size_t min_blocks     = block_count_ + need - std::min( need, free_count_ );
+  const std::size_t want_blocks    = std::min( max_blocks_, std::max( min_blocks, block_count_ * 2 ) );
+  std::size_t       new_committed  = std::min( reserved_bytes, round_up( want_blocks * stride_, page_size() ) );
+  if ( budget_ && !budget_->charge( new_committed - committed_bytes_ ) ) {
+    // Over budget for the full step: settle for what this request needs
+    const std::size_t min_committed = std::min( reserved_bytes, round_up( min_blocks * stride_, page_size() ) );
+    if ( min_committed == new_committed || !budget_->charge( min_committed - committed_bytes_ ) ) {
+      return false;
+    }
+    new_committed = min_committed;
+  }
+  // Register the new pages, adopted slabs included, before they can hold a block
+  bool registered = new_committed == committed_bytes_; // blocks may still fit in the last committed page
+  try {
+    registered = registered || PageMap::insert( region_ + committed_bytes_, new_committed - committed_bytes_, this );
+  } catch ( const std::bad_alloc & ) {
+    // Treated like a refused charge: no growth
+  }
+  if ( !registered ) {
+    if ( budget_ ) {
+      budget_->uncharge( new_committed - committed_bytes_ );
+    }
+    return false;
+  }
+  const std::size_t registered_bytes = new_committed;
+  if ( page_pool_ ) {
+    adopt_slabs_unlocked( new_committed );
+  }
+  if ( new_committed > committed_bytes_ &&
+       mprotect( region_ + committed_bytes_, new_committed - committed_bytes_, PROT_READ | PROT_WRITE ) != 0 ) {
+    // Keep whatever slabs were adopted
+    if ( budget_ ) {
+      budget_->uncharge( new_committed - committed_bytes_ );
+    }
+    new_committed = committed_bytes_;
+  }
+  committed_bytes_ = new_committed;
+  PageMap::erase( region_ + committed_bytes_, registered_bytes - committed_bytes_ );
+
+  const std::size_t new_count = std::min( max_blocks_, committed_bytes_ / stride_ );
+  free_count_ += new_count - block_count_;
+  block_count_ = new_count;
+  return free_count_ >= need;
+}
+
+bool BlockAllocator::grow_locked( std::unique_lock< std::mutex > & lock, std::size_t need ) {
+  if ( budget_ && streams_.empty() && need > free_count_ && block_count_ < max_blocks_ ) {
+    const std::size_t reserved_bytes = round_up( stride_ * max_blocks_, page_size() );
+    const std::size_t min_blocks     = std::min( max_blocks_, block_count_ + need - free_count_ );
+    const std::size_t min_committed  = std::min( reserved_bytes, round_up( min_blocks * stride_, page_size() ) );
+    const std::size_t bytes          = min_committed - committed_bytes_;
+    const std::size_t used           = budget_->used();
+    if ( used + bytes > budget_->soft_limit() ) {
+      // Ask the other pools for memory without holding our lock, so their callbacks may free into us
+      lock.unlock();
+      budget_->reclaim( used + bytes - budget_->soft_limit(), budget_id_ );
+      lock.lock();
+      if ( available_unlocked( 0 ) >= need ) {
+        return true;
+      }
+    }
+  }
+  return grow_unlocked( need );
+}
+
+bool BlockAllocator::recover_locked( std::unique_lock< std::mutex > & lock, std::size_t stream, std::size_t k ) {
+  // An allocation made by a handler must not start another pass
+  if ( !has_handlers_.load( std::memory_order_acquire ) ||
+       handling_thread_.load( std::memory_order_relaxed ) == std::this_thread::get_id() ) {
+    return false;
+  }
+  lock.unlock();
+  std::lock_guard< std::mutex > chain( handlers_mtx_ );
+  handling_thread_.store( std::this_thread::get_id(), std::memory_order_relaxed );
+  bool ready    = false;
+  bool progress = true;
+  try {
+    for ( std::size_t pass = 0;; ++pass ) {
+      // A pass run by another thread, or a plain free, may already have made room
+      lock.lock();
+      ready = available_unlocked( stream ) >= k || ( stream == 0 && grow_locked( lock, k ) );
+      if ( ready || !progress || pass == exhaustion_retries_ ) {
+        break;
+      }
+      lock.unlock();
+      progress = false;
+      for ( auto & handler : handlers_ ) {
+        progress = handler.second( *this, k ) || progress;
+      }
+    }
+  } catch ( ... ) {
+    handling_thread_.store( std::thread::id{}, std::memory_order_relaxed );
+    throw;
+  }
+  handling_thread_.store( std::thread::id{}, std::memory_order_relaxed );
+  return ready;
+}
+
+std::size_t BlockAllocator::add_exhaustion_handler( ExhaustionHandler handler ) {
+  std::lock_guard< std::mutex > lock( handlers_mtx_ );
+  const std::size_t             id = next_handler_id_++;
+  handlers_.emplace_back( id, std::move( handler ) );
+  has_handlers_.store( true, std::memory_order_release );
+  return id;
+}
+
+void BlockAllocator::remove_exhaustion_handler( std::size_t id ) {
+  std::lock_guard< std::mutex > lock( handlers_mtx_ );
+  handlers_.erase( std::remove_if( handlers_.begin(), handlers_.end(),
+                                   [id]( const std::pair< std::size_t, ExhaustionHandler > & h ) { return h.first == id; } ),
+                   handlers_.end() );
+  has_handlers_.store( !handlers_.empty(), std::memory_order_release );
+}
+
+void BlockAllocator::adopt_slabs_unlocked( std::size_t target_bytes ) noexcept {
+  const std::size_t slab    = page_pool_->slab_bytes();
+  bool              adopted = false;
+  while ( committed_bytes_ < target_bytes ) {
+    void * donated = page_pool_->take();
+    if ( !donated ) {
+      break;
+    }
+    // Move the slab over the PROT_NONE reservation at the growth frontier; a slab past the target is trimmed
+    const std::size_t len    = std::min( slab, target_bytes - committed_bytes_ );
+    void *            target = region_ + committed_bytes_;
+    if ( mremap( donated, slab, len, MREMAP_MAYMOVE | MREMAP_FIXED, target ) == MAP_FAILED ) {
+      page_pool_->put( donated );
+      break;
+    }
+    committed_bytes_ += len;
+    adopted = true;
+  }
+  if ( adopted ) {
+    // Recycled pages hold the donor's data
+    touched_ = std::max( touched_, std::min( max_blocks_, committed_bytes_ / stride_ ) );
+  }
+}
+
+std::size_t BlockAllocator::free_tail_bytes_unlocked() const noexcept {
+  std::size_t first_free = block_count_;
+  while ( first_free > 0 && !test_bit( occupancy_, first_free - 1 ) ) {
+    --first_free;
+  }
+  return committed_bytes_ - first_free * stride_;
+}
+
+void BlockAllocator::shrink_unlocked( std::size_t new_committed ) noexcept {
+  const std::size_t new_count = std::min( max_blocks_, new_committed / stride_ );
+  for ( FreeNode ** head : { &free_list_, &long_free_list_ } ) {
+    for ( FreeNode ** link = head; *link; ) {
+      if ( index_of_node( *link ) >= new_count ) {
+        *link = ( *link )->next;
+      }
+      else {
+        link = &( *link )->next;
+      }
+    }
+  }
+  for ( std::size_t b = new_count; b < block_count_; ++b ) {
+    if ( test_bit( parked_, b ) ) {
+      clear_bit( parked_, b );
+      --parked_count_;
+    }
+    clear_bit( long_side_, b );
+  }
+  parked_hint_ = std::min( parked_hint_, new_count / 64 );
+  long_end_    = std::min( long_end_, new_count );
+  long_cur_    = std::min( long_cur_, long_end_ );
+  bump_        = std::min( bump_, new_count );
+  if ( touched_ > new_count ) {
+    // The dropped block straddling the kept pages must read as zero when it comes back
+    std::memset( region_ + new_count * stride_, 0, new_committed - new_count * stride_ );
+    touched_ = new_count;
+  }
+  free_count_ -= block_count_ - new_count;
+  block_count_ = new_count;
+  PageMap::erase( region_ + new_committed, committed_bytes_ - new_committed );
+}
+
+BlockAllocator::AsyncBuffer & BlockAllocator::thread_buffer() {
+  // Keyed by id_ rather than this, so a new allocator at a recycled address gets its own buffer
+  thread_local std::vector< std::pair< std::uint64_t, std::shared_ptr< AsyncBuffer > > > buffers;
+  for ( const auto & entry : buffers ) {
+    if ( entry.first == id_ ) {
+      return *entry.second;
+    }
+  }
+
+  // First use on this thread: drop buffers of destroyed allocators and register a new one
+  buffers.erase( std::remove_if( buffers.begin(), buffers.end(),
+                                 []( const auto & entry ) { return entry.second->orphaned.load( std::memory_order_acquire ); } ),
+                 buffers.end() );
+  auto buffer = std::make_shared< AsyncBuffer >();
+  {
+    std::lock_guard< std::mutex > lock( async_mtx_ );
+    async_buffers_.push_back( buffer );
+  }
+  buffers.emplace_back( id_, buffer );
+  return *buffer;
+}
+
+std::size_t BlockAllocator::drain_locked( AsyncBuffer * only ) {
+  std::vector< std::size_t > idx;
+  auto collect = [&]( void * p ) { idx.push_back( index_of_node( p ) ); };
+  if ( only ) {
+    only->consume( collect );
+  }
+  else {
+    for ( const auto & buffer : async_buffers_ ) {
+      buffer->consume( collect );
+    }
+  }
+  if ( idx.empty() ) {
+    return 0;
+  }
+  radix_sort( idx, max_blocks_ - 1 );
+
+  std::size_t rejected = 0;
+  {
+    std::lock_guard< std::mutex > lock( mtx_ );
+    for ( std::size_t i = idx.size(); i-- > 0; ) {
+      if ( queued_ ) {
+        queued_[idx[i] / 64].fetch_and( ~( std::uint64_t{ 1 } << ( idx[i] % 64 ) ), std::memory_order_relaxed );
+      }
+      if ( idx[i] >= block_count_ || !test_bit( occupancy_, idx[i] ) || ( i > 0 && idx[i] == idx[i - 1] ) ) {
+        ++rejected;
+        continue;
+      }
+      push_unlocked( idx[i] );
+    }
+    notify_waiters_unlocked();
+  }
+  pending_frees_.fetch_sub( idx.size(), std::memory_order_relaxed );
+
+  if ( rejected != 0 ) {
+    throw std::runtime_error( "BlockAllocator::drain: double free or corruption detected" );
+  }
+  return idx.size() - rejected;
+}
+
+bool BlockAllocator::sample_if_due( SampledStack & stack ) noexcept {
+  const std::size_t interval = sample_interval_.load( std::memory_order_relaxed );
+  if ( interval == 0 ) {
+    return false;
+  }
+  // Racing threads may both reset the countdown; the rate only needs to be approximate
+  if ( sample_countdown_.fetch_sub( 1, std::memory_order_relaxed ) > 1 ) {
+    return false;
+  }
+  sample_countdown_.store( interval, std::memory_order_relaxed );
+  stack.depth = capture_stack( stack.frames.data(), kSampleFrames );
+  return stack.depth > 0;
+}
+
+void BlockAllocator::record_sample_unlocked( const void * p, const SampledStack & stack ) noexcept {
+  if ( sample_interval_.load( std::memory_order_relaxed ) == 0 ) {
+    return; // disabled while the stack was being captured
+  }
+  try {
+    samples_[index_of_node( p )] = stack;
+  } catch ( const std::bad_alloc & ) {
+    // Losing a sample is preferable to failing the allocation
+  }
+}
+
+void BlockAllocator::notify_waiters_unlocked() noexcept {
+  // Wake waiters only when the smallest pending request can be satisfied
+  if ( !wait_ks_.empty() && available_unlocked( 0 ) >= *wait_ks_.begin() ) {
+    cv_.notify_all();
+  }
+}
+
+std::size_t BlockAllocator::index_of_node( const void * node ) const noexcept {
+  return static_cast< std::size_t >( static_cast< const std::byte * >( node ) - region_ ) / stride_;
+}
+
+void BlockAllocator::clear_block( void * p, std::size_t size ) noexcept {
+#if defined( __SSE2__ )
+  if ( size >= kStreamingClearBytes ) {
+    // Streaming stores keep a large clear from evicting the working set
+    auto *            bytes = static_cast< std::byte * >( p );
+    const auto        addr  = reinterpret_cast< std::uintptr_t >( bytes );
+    const std::size_t head  = round_up( addr, 16 ) - addr;
+    std::memset( bytes, 0, head );
+    const std::size_t body = ( size - head ) & ~std::size_t{ 15 };
+    const __m128i     zero = _mm_setzero_si128();
+    for ( std::size_t off = head; off < head + body; off += 16 ) {
+      _mm_stream_si128( reinterpret_cast< __m128i * >( bytes + off ), zero );
+    }
+    _mm_sfence();
+    std::memset( bytes + head + body, 0, size - head - body );
+    return;
+  }
+#endif
+  std::memset( p, 0, size );
+}
+
 bool BlockAllocator::is_from_region_unlocked( const void * p ) const noexcept {
   auto addr = reinterpret_cast< const std::byte * >( p );
   return addr >= region_ && addr < ( region_ + stride_ * block_count_ ) &&
@@ -0,0 +1,62 @@
+#include "memory_budget.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace mem {
+
+MemoryBudget::MemoryBudget( std::size_t hard_limit, std::size_t soft_limit )
+    : hard_{ hard_limit }, soft_{ soft_limit == 0 ? hard_limit : soft_limit }, used_{ 0 }, next_id_{ 1 }, cursor_{ 0 } {
+  if ( hard_ == 0 ) {
+    throw std::invalid_argument( "MemoryBudget: hard_limit must be > 0" );
+  }
+  if ( soft_ > hard_ ) {
+    throw std::invalid_argument( "MemoryBudget: soft_limit must not exceed hard_limit" );
+  }
+}
+
+bool MemoryBudget::charge( std::size_t bytes ) noexcept {
+  std::size_t cur = used_.load( std::memory_order_relaxed );
+  do {
+    if ( bytes > hard_ - cur ) {
+      return false;
+    }
+  } while ( !used_.compare_exchange_weak( cur, cur + bytes, std::memory_order_relaxed ) );
+  return true;
+}
+
+void MemoryBudget::uncharge( std::size_t bytes ) noexcept { used_.fetch_sub( bytes, std::memory_order_relaxed ); }
+
+std::size_t MemoryBudget::add_reclaimer( ReclaimCallback callback ) {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  const std::size_t             id = next_id_++;
+  reclaimers_.push_back( Reclaimer{ id, std::move( callback ) } );
+  return id;
+}
+
+void MemoryBudget::remove_reclaimer( std::size_t id ) {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  reclaimers_.erase( std::remove_if( reclaimers_.begin(), reclaimers_.end(), [id]( const Reclaimer & r ) { return r.id == id; } ),
+                     reclaimers_.end() );
+}
+
+std::size_t MemoryBudget::reclaim( std::size_t bytes, std::size_t skip ) {
+  std::unique_lock< std::mutex > lock( mtx_, std::try_to_lock );
+  if ( !lock.owns_lock() || reclaimers_.empty() ) {
+    return 0;
+  }
+
+  std::size_t       got   = 0;
+  const std::size_t n     = reclaimers_.size();
+  const std::size_t start = cursor_ % n;
+  for ( std::size_t i = 0; i < n && got < bytes; ++i ) {
+    Reclaimer & r = reclaimers_[( start + i ) % n];
+    if ( r.id != skip ) {
+      got += r.callback( bytes - got );
+    }
+  }
+  cursor_ = start + 1;
+  return got;
+}
+
+} // namespace mem
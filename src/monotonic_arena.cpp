@@ -0,0 +1,66 @@
+#include "monotonic_arena.hpp"
+
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+
+namespace mem {
+
+static std::size_t header_bytes( std::size_t alignment ) noexcept {
+  // Keep the first allocation in a chunk at the pool's alignment
+  return ( sizeof( void * ) + alignment - 1 ) & ~( alignment - 1 );
+}
+
+MonotonicArena::MonotonicArena( BlockAllocator & chunks ) noexcept
+    : chunks_{ chunks }, head_{ nullptr }, cur_{ nullptr }, end_{ nullptr }, chunk_count_{ 0 } {}
+
+MonotonicArena::~MonotonicArena() noexcept { release(); }
+
+void * MonotonicArena::allocate( std::size_t size, std::size_t alignment ) {
+  if ( alignment == 0 || ( alignment & ( alignment - 1 ) ) != 0 ) {
+    throw std::invalid_argument( "MonotonicArena: alignment must be a power of two" );
+  }
+  if ( size == 0 ) {
+    size = 1;
+  }
+
+  // Fast path: bump within the current chunk
+  const auto        cur     = reinterpret_cast< std::uintptr_t >( cur_ );
+  const std::size_t padding = ( alignment - cur % alignment ) % alignment;
+  const std::size_t room    = cur_ ? static_cast< std::size_t >( end_ - cur_ ) : 0;
+  if ( padding <= room && size <= room - padding ) {
+    cur_ += padding;
+    void * p = cur_;
+    cur_ += size;
+    return p;
+  }
+
+  // Slow path: start a new chunk (alignment beyond the pool's costs padding inside it)
+  const std::size_t slack = alignment > chunks_.alignment() ? alignment - chunks_.alignment() : 0;
+  if ( size > max_allocation() || slack > max_allocation() - size ) {
+    throw std::bad_alloc();
+  }
+  auto * chunk = static_cast< ChunkHeader * >( chunks_.allocate() );
+  chunk->prev  = head_;
+  head_        = chunk;
+  ++chunk_count_;
+  cur_ = reinterpret_cast< std::byte * >( chunk ) + header_bytes( chunks_.alignment() );
+  end_ = reinterpret_cast< std::byte * >( chunk ) + chunks_.block_size();
+  return allocate( size, alignment );
+}
+
+void MonotonicArena::release() noexcept {
+  // The chunks are already chained through ChunkHeader::prev, their first bytes: one locked splice, no heap
+  chunks_.deallocate_chain( head_ );
+  head_        = nullptr;
+  cur_         = nullptr;
+  end_         = nullptr;
+  chunk_count_ = 0;
+}
+
+std::size_t MonotonicArena::max_allocation() const noexcept {
+  const std::size_t header = header_bytes( chunks_.alignment() );
+  return chunks_.block_size() > header ? chunks_.block_size() - header : 0;
+}
+
+} // namespace mem
@@ -0,0 +1,123 @@
+#include "page_map.hpp"
+#include "block_allocator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+
+namespace mem {
+
+namespace {
+
+constexpr unsigned      kPageShift = 12; // 4 KiB: every mmap'd reservation is a whole number of these
+constexpr unsigned      kLevelBits = 12; // 3 levels x 12 bits + 12 page bits = 48-bit addresses
+constexpr std::size_t   kFanout    = std::size_t{ 1 } << kLevelBits;
+constexpr std::uint64_t kMaxPage   = std::uint64_t{ 1 } << ( 3 * kLevelBits );
+
+struct Leaf {
+  std::atomic< BlockAllocator * > owner[kFanout];
+};
+
+struct Interior {
+  std::atomic< Leaf * > leaf[kFanout];
+};
+
+// Zero-initialized static storage, so usable before any constructor runs
+std::atomic< Interior * > root[kFanout];
+std::mutex                writer_mtx;
+
+std::size_t top( std::uint64_t page ) noexcept { return static_cast< std::size_t >( page >> ( 2 * kLevelBits ) ); }
+std::size_t mid( std::uint64_t page ) noexcept { return static_cast< std::size_t >( page >> kLevelBits ) & ( kFanout - 1 ); }
+std::size_t low( std::uint64_t page ) noexcept { return static_cast< std::size_t >( page ) & ( kFanout - 1 ); }
+
+// Pages [first, last) overlapping [base, base + bytes); false if the range is empty or not covered
+bool page_range( const void * base, std::size_t bytes, std::uint64_t & first, std::uint64_t & last ) noexcept {
+  const auto addr = static_cast< std::uint64_t >( reinterpret_cast< std::uintptr_t >( base ) );
+  first           = addr >> kPageShift;
+  last            = ( addr + bytes + ( std::uint64_t{ 1 } << kPageShift ) - 1 ) >> kPageShift;
+  return first < last && last <= kMaxPage;
+}
+
+// Caller holds writer_mtx when creating
+Leaf * leaf_for( std::uint64_t page, bool create ) {
+  Interior * node = root[top( page )].load( std::memory_order_acquire );
+  if ( !node ) {
+    if ( !create ) {
+      return nullptr;
+    }
+    node = new Interior();
+    root[top( page )].store( node, std::memory_order_release );
+  }
+  Leaf * leaf = node->leaf[mid( page )].load( std::memory_order_acquire );
+  if ( !leaf && create ) {
+    leaf = new Leaf();
+    node->leaf[mid( page )].store( leaf, std::memory_order_release );
+  }
+  return leaf;
+}
+
+void assign( std::uint64_t first, std::uint64_t last, BlockAllocator * owner ) noexcept {
+  for ( std::uint64_t page = first; page < last; ) {
+    // Whole leaves at a time; every leaf in range exists
+    Leaf *              leaf = leaf_for( page, false );
+    const std::uint64_t end  = std::min( last, ( page | ( kFanout - 1 ) ) + 1 );
+    for ( ; page < end; ++page ) {
+      // Relaxed: a pointer only reaches another thread after its pool was constructed
+      leaf->owner[low( page )].store( owner, std::memory_order_relaxed );
+    }
+  }
+}
+
+} // namespace
+
+bool PageMap::insert( const void * base, std::size_t bytes, BlockAllocator * owner ) {
+  std::uint64_t first, last;
+  if ( !page_range( base, bytes, first, last ) ) {
+    return false;
+  }
+  std::lock_guard< std::mutex > lock( writer_mtx );
+  // Create every node first, so a failed allocation leaves no half-registered range
+  for ( std::uint64_t page = first; page < last; page = ( page | ( kFanout - 1 ) ) + 1 ) {
+    leaf_for( page, true );
+  }
+  assign( first, last, owner );
+  return true;
+}
+
+void PageMap::erase( const void * base, std::size_t bytes ) noexcept {
+  std::uint64_t first, last;
+  if ( !page_range( base, bytes, first, last ) ) {
+    return;
+  }
+  std::lock_guard< std::mutex > lock( writer_mtx );
+  assign( first, last, nullptr );
+}
+
+BlockAllocator * PageMap::find( const void * p ) noexcept {
+  const std::uint64_t page = static_cast< std::uint64_t >( reinterpret_cast< std::uintptr_t >( p ) ) >> kPageShift;
+  if ( page >= kMaxPage ) {
+    return nullptr;
+  }
+  const Interior * node = root[top( page )].load( std::memory_order_acquire );
+  if ( !node ) {
+    return nullptr;
+  }
+  const Leaf * leaf = node->leaf[mid( page )].load( std::memory_order_acquire );
+  return leaf ? leaf->owner[low( page )].load( std::memory_order_relaxed ) : nullptr;
+}
+
+void deallocate( void * p ) {
+  if ( !p ) {
+    return;
+  }
+  BlockAllocator * owner = PageMap::find( p );
+  if ( !owner ) {
+    throw std::runtime_error( "mem::deallocate: pointer does not belong to any BlockAllocator" );
+  }
+  owner->deallocate( p );
+}
+
+} // namespace mem
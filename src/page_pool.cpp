@@ -0,0 +1,66 @@
+#include "page_pool.hpp"
+
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace mem {
+
+PagePool::PagePool( std::size_t slab_bytes, std::size_t max_bytes ) : slab_bytes_{ slab_bytes }, max_bytes_{ max_bytes } {
+  const auto page = static_cast< std::size_t >( sysconf( _SC_PAGESIZE ) );
+  if ( slab_bytes_ == 0 || slab_bytes_ % page != 0 ) {
+    throw std::invalid_argument( "PagePool: slab_bytes must be a non-zero multiple of the page size" );
+  }
+}
+
+PagePool::~PagePool() noexcept { trim( 0 ); }
+
+std::size_t PagePool::held_slabs() const noexcept {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  return slabs_.size();
+}
+
+bool PagePool::put( void * slab ) noexcept {
+  if ( !slab ) {
+    return false;
+  }
+  {
+    std::lock_guard< std::mutex > lock( mtx_ );
+    if ( max_bytes_ == 0 || ( slabs_.size() + 1 ) * slab_bytes_ <= max_bytes_ ) {
+      try {
+        slabs_.push_back( slab );
+        return true;
+      } catch ( const std::bad_alloc & ) {
+        // Fall through and give the pages back instead
+      }
+    }
+  }
+  munmap( slab, slab_bytes_ );
+  return false;
+}
+
+void * PagePool::take() noexcept {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  if ( slabs_.empty() ) {
+    return nullptr;
+  }
+  void * slab = slabs_.back();
+  slabs_.pop_back();
+  return slab;
+}
+
+std::size_t PagePool::trim( std::size_t keep_slabs ) noexcept {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  // Oldest donations are the coldest; unmap those first
+  const std::size_t n     = slabs_.size() > keep_slabs ? slabs_.size() - keep_slabs : 0;
+  const auto        first = slabs_.begin();
+  const auto        last  = first + static_cast< std::ptrdiff_t >( n );
+  for ( auto it = first; it != last; ++it ) {
+    munmap( *it, slab_bytes_ );
+  }
+  slabs_.erase( first, last );
+  return n * slab_bytes_;
+}
+
+} // namespace mem
@@ -0,0 +1,163 @@
+#include "pressure_monitor.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace mem {
+
+// Parse "avg10=<x>" from a PSI line such as "some avg10=1.23 avg60=0.50 avg300=0.10 total=1234"
+static bool parse_avg10( const std::string & line, double & out ) {
+  std::istringstream in( line );
+  std::string        field;
+  while ( in >> field ) {
+    if ( field.rfind( "avg10=", 0 ) == 0 ) {
+      try {
+        out = std::stod( field.substr( 6 ) );
+        return true;
+      } catch ( const std::exception & ) {
+        return false;
+      }
+    }
+  }
+  return false;
+}
+
+PressureMonitor::PressureMonitor( std::string cgroup_dir, double threshold_avg10 )
+    : cgroup_dir_{ std::move( cgroup_dir ) }, threshold_{ threshold_avg10 }, armed_{ true }, released_{ 0 }, stop_{ false } {}
+
+PressureMonitor::~PressureMonitor() noexcept { stop(); }
+
+void PressureMonitor::watch( BlockAllocator & pool ) {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  if ( std::find( pools_.begin(), pools_.end(), &pool ) == pools_.end() ) {
+    pools_.push_back( &pool );
+  }
+}
+
+void PressureMonitor::unwatch( BlockAllocator & pool ) {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  pools_.erase( std::remove( pools_.begin(), pools_.end(), &pool ), pools_.end() );
+}
+
+void PressureMonitor::on_pressure( ShrinkCallback callback ) {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  callbacks_.push_back( std::move( callback ) );
+}
+
+PressureSample PressureMonitor::sample() const {
+  PressureSample result{ memory_limit( cgroup_dir_ ), 0.0, 0.0 };
+
+  std::ifstream in( cgroup_dir_ + "/memory.pressure" );
+  if ( !in ) {
+    throw std::runtime_error( "PressureMonitor: cannot read " + cgroup_dir_ + "/memory.pressure" );
+  }
+  bool        have_some = false;
+  std::string line;
+  while ( std::getline( in, line ) ) {
+    if ( line.rfind( "some ", 0 ) == 0 ) {
+      have_some = parse_avg10( line, result.some_avg10 );
+    }
+    else if ( line.rfind( "full ", 0 ) == 0 ) {
+      parse_avg10( line, result.full_avg10 );
+    }
+  }
+  if ( !have_some ) {
+    throw std::runtime_error( "PressureMonitor: malformed " + cgroup_dir_ + "/memory.pressure" );
+  }
+  return result;
+}
+
+bool PressureMonitor::poll() {
+  const PressureSample current = sample();
+
+  std::vector< ShrinkCallback > callbacks;
+  {
+    std::lock_guard< std::mutex > lock( mtx_ );
+    if ( current.some_avg10 < threshold_ ) {
+      armed_ = true;
+      return false;
+    }
+    if ( !armed_ ) {
+      return false;
+    }
+    armed_ = false;
+
+    for ( BlockAllocator * pool : pools_ ) {
+      released_ += pool->release_free_pages();
+    }
+    callbacks = callbacks_;
+  }
+  // Outside the lock, so a callback may register callbacks or free into pools whose reclaim reaches back here
+  for ( const auto & callback : callbacks ) {
+    callback( current );
+  }
+  return true;
+}
+
+std::size_t PressureMonitor::bytes_released() const noexcept {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  return released_;
+}
+
+void PressureMonitor::start( std::chrono::milliseconds interval ) {
+  std::lock_guard< std::mutex > lock( thread_mtx_ );
+  if ( worker_.joinable() ) {
+    throw std::logic_error( "PressureMonitor::start: already running" );
+  }
+  stop_   = false;
+  worker_ = std::thread( [this, interval]() {
+    std::unique_lock< std::mutex > wait_lock( thread_mtx_ );
+    while ( !thread_cv_.wait_for( wait_lock, interval, [this] { return stop_; } ) ) {
+      wait_lock.unlock();
+      try {
+        poll();
+      } catch ( const std::exception & ) {
+        // The cgroup files may be briefly unavailable; try again next interval
+      }
+      wait_lock.lock();
+    }
+  } );
+}
+
+void PressureMonitor::stop() noexcept {
+  std::thread worker;
+  {
+    std::lock_guard< std::mutex > lock( thread_mtx_ );
+    stop_  = true;
+    worker = std::move( worker_ );
+  }
+  thread_cv_.notify_all();
+  if ( worker.joinable() ) {
+    worker.join();
+  }
+}
+
+std::optional< std::size_t > PressureMonitor::memory_limit( const std::string & cgroup_dir ) {
+  std::ifstream in( cgroup_dir + "/memory.max" );
+  std::string   value;
+  if ( !( in >> value ) || value == "max" ) {
+    return std::nullopt;
+  }
+  try {
+    return static_cast< std::size_t >( std::stoull( value ) );
+  } catch ( const std::exception & ) {
+    return std::nullopt;
+  }
+}
+
+std::size_t PressureMonitor::block_count_for_limit( const std::string & cgroup_dir, std::size_t block_bytes, double fraction,
+                                                    std::size_t fallback ) {
+  if ( block_bytes == 0 || !( fraction > 0.0 && fraction <= 1.0 ) ) {
+    throw std::invalid_argument( "PressureMonitor::block_count_for_limit: block_bytes must be > 0 and fraction in (0, 1]" );
+  }
+  const std::optional< std::size_t > limit = memory_limit( cgroup_dir );
+  if ( !limit ) {
+    return fallback;
+  }
+  const auto budget = static_cast< std::size_t >( static_cast< double >( *limit ) * fraction );
+  return std::max< std::size_t >( 1, budget / block_bytes );
+}
+
+} // namespace mem
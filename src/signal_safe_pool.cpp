@@ -0,0 +1,112 @@
+#include "signal_safe_pool.hpp"
+
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace mem {
+
+namespace {
+
+std::size_t round_up( std::size_t value, std::size_t align ) noexcept { return ( value + align - 1 ) & ~( align - 1 ); }
+
+// Next head word: bump the version so a stale CAS against the same index fails
+std::uint64_t next_head( std::uint64_t head, std::uint32_t index ) noexcept {
+  return ( ( ( head >> 32 ) + 1 ) << 32 ) | index;
+}
+
+} // namespace
+
+SignalSafePool::SignalSafePool( std::size_t block_size, std::size_t block_count, std::size_t alignment )
+    : block_size_{ block_size }, block_count_{ block_count }, stride_{ 0 }, map_base_{ nullptr }, map_bytes_{ 0 },
+      region_{ nullptr }, head_{ 0 }, free_{ block_count } {
+  if ( block_size_ == 0 || block_count_ == 0 ) {
+    throw std::invalid_argument( "SignalSafePool: block_size and block_count must be > 0" );
+  }
+  if ( alignment == 0 || ( alignment & ( alignment - 1 ) ) != 0 ) {
+    throw std::invalid_argument( "SignalSafePool: alignment must be a power of two" );
+  }
+  if ( block_count_ >= kNil ) {
+    throw std::invalid_argument( "SignalSafePool: block_count must be < 2^32 - 1" );
+  }
+  stride_ = round_up( block_size_, alignment );
+  if ( stride_ < block_size_ || stride_ > ( static_cast< std::size_t >( -1 ) / 2 ) / block_count_ ) {
+    throw std::invalid_argument( "SignalSafePool: size overflow" );
+  }
+
+  // Populate up front: a handler must not be the first to touch a page
+  const auto        page  = static_cast< std::size_t >( sysconf( _SC_PAGESIZE ) );
+  const std::size_t extra = alignment > page ? alignment : 0;
+  const int         flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+  map_bytes_              = round_up( stride_ * block_count_, page ) + extra;
+  void * base             = mmap( nullptr, map_bytes_, PROT_READ | PROT_WRITE, flags, -1, 0 );
+  if ( base == MAP_FAILED ) {
+    throw std::bad_alloc();
+  }
+  map_base_ = static_cast< std::byte * >( base );
+  region_   = reinterpret_cast< std::byte * >( round_up( reinterpret_cast< std::uintptr_t >( map_base_ ), alignment ) );
+
+  try {
+    next_.reset( new std::atomic< std::uint32_t >[block_count_] );
+    allocated_.reset( new std::atomic< std::uint64_t >[( block_count_ + 63 ) / 64] );
+  } catch ( ... ) {
+    munmap( map_base_, map_bytes_ );
+    throw;
+  }
+  for ( std::size_t i = 0; i < block_count_; ++i ) {
+    next_[i].store( i + 1 < block_count_ ? static_cast< std::uint32_t >( i + 1 ) : kNil, std::memory_order_relaxed );
+  }
+  for ( std::size_t w = 0; w < ( block_count_ + 63 ) / 64; ++w ) {
+    allocated_[w].store( 0, std::memory_order_relaxed );
+  }
+  head_.store( 0, std::memory_order_release ); // block 0 on top, version 0
+}
+
+SignalSafePool::~SignalSafePool() noexcept { munmap( map_base_, map_bytes_ ); }
+
+void * SignalSafePool::allocate() noexcept {
+  std::uint64_t head = head_.load( std::memory_order_acquire );
+  std::uint32_t top;
+  do {
+    top = static_cast< std::uint32_t >( head );
+    if ( top == kNil ) {
+      return nullptr;
+    }
+    // May read a link a racing pop/push already changed; the version makes that CAS fail
+  } while ( !head_.compare_exchange_weak( head, next_head( head, next_[top].load( std::memory_order_relaxed ) ),
+                                          std::memory_order_acquire, std::memory_order_acquire ) );
+  allocated_[top / 64].fetch_or( std::uint64_t{ 1 } << ( top % 64 ), std::memory_order_relaxed );
+  free_.fetch_sub( 1, std::memory_order_relaxed );
+  return region_ + static_cast< std::size_t >( top ) * stride_;
+}
+
+bool SignalSafePool::deallocate( void * p ) noexcept {
+  if ( !p ) {
+    return true;
+  }
+  if ( !owns( p ) ) {
+    return false;
+  }
+  const auto          off = static_cast< std::size_t >( static_cast< std::byte * >( p ) - region_ );
+  const auto          idx = static_cast< std::uint32_t >( off / stride_ );
+  const std::uint64_t bit = std::uint64_t{ 1 } << ( idx % 64 );
+  if ( ( allocated_[idx / 64].fetch_and( ~bit, std::memory_order_relaxed ) & bit ) == 0 ) {
+    return false; // double free: the block is already on the stack
+  }
+
+  std::uint64_t head = head_.load( std::memory_order_relaxed );
+  do {
+    next_[idx].store( static_cast< std::uint32_t >( head ), std::memory_order_relaxed );
+  } while ( !head_.compare_exchange_weak( head, next_head( head, idx ), std::memory_order_release, std::memory_order_relaxed ) );
+  free_.fetch_add( 1, std::memory_order_relaxed );
+  return true;
+}
+
+bool SignalSafePool::owns( const void * p ) const noexcept {
+  const auto addr = reinterpret_cast< std::uintptr_t >( p );
+  const auto base = reinterpret_cast< std::uintptr_t >( region_ );
+  return addr >= base && addr - base < stride_ * block_count_ && ( addr - base ) % stride_ == 0;
+}
+
+} // namespace mem
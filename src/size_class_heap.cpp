@@ -0,0 +1,218 @@
+#include "size_class_heap.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace mem {
+
+namespace {
+
+constexpr std::size_t kGranule = 16; // block alignment and size-class step
+
+std::size_t round_up( std::size_t value, std::size_t align ) noexcept { return ( value + align - 1 ) & ~( align - 1 ); }
+
+} // namespace
+
+const std::vector< std::size_t > & SizeClassHeap::default_classes() {
+  static const std::vector< std::size_t > classes{ 16,  32,  48,   64,   96,   128,  192, 256,
+                                                   384, 512, 768, 1024, 1536, 2048, 4096, 8192 };
+  return classes;
+}
+
+SizeClassHeap::SizeClassHeap( std::size_t region_bytes, std::vector< std::size_t > class_sizes, std::size_t page_bytes )
+    : page_bytes_{ page_bytes }, page_shift_{ 0 }, map_base_{ nullptr }, map_bytes_{ 0 }, region_{ nullptr },
+      free_pages_{ kNone }, free_page_count_{ 0 } {
+  const auto system_page = static_cast< std::size_t >( sysconf( _SC_PAGESIZE ) );
+  if ( page_bytes_ == 0 || ( page_bytes_ & ( page_bytes_ - 1 ) ) != 0 || page_bytes_ % system_page != 0 ) {
+    throw std::invalid_argument( "SizeClassHeap: page_bytes must be a power of two and a multiple of the system page size" );
+  }
+  const std::size_t page_count = region_bytes / page_bytes_;
+  if ( page_count == 0 || page_count >= kNone ) {
+    throw std::invalid_argument( "SizeClassHeap: region must hold between 1 and 2^32 - 1 pages" );
+  }
+  if ( class_sizes.empty() ) {
+    class_sizes = default_classes();
+  }
+  if ( class_sizes.size() > 255 ) {
+    throw std::invalid_argument( "SizeClassHeap: at most 255 size classes" );
+  }
+  for ( std::size_t i = 0; i < class_sizes.size(); ++i ) {
+    const std::size_t size = round_up( std::max< std::size_t >( class_sizes[i], 1 ), kGranule );
+    if ( size > page_bytes_ || ( i > 0 && size <= classes_.back().size ) ) {
+      throw std::invalid_argument( "SizeClassHeap: class sizes must be ascending and fit in a page" );
+    }
+    classes_.push_back( SizeClass{ size, static_cast< std::uint32_t >( page_bytes_ / size ), kNone, 0 } );
+  }
+  class_of_.resize( classes_.back().size / kGranule + 1 );
+  for ( std::size_t g = 0, c = 0; g < class_of_.size(); ++g ) {
+    while ( classes_[c].size < g * kGranule ) {
+      ++c;
+    }
+    class_of_[g] = static_cast< std::uint8_t >( c );
+  }
+  page_shift_ = static_cast< unsigned >( __builtin_ctzll( page_bytes_ ) );
+
+  // Pages must be aligned to their size so a pointer maps to its page with a shift
+  map_bytes_ = page_count * page_bytes_ + page_bytes_;
+  void * base = mmap( nullptr, map_bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+  if ( base == MAP_FAILED ) {
+    throw std::bad_alloc();
+  }
+  map_base_ = static_cast< std::byte * >( base );
+  region_   = reinterpret_cast< std::byte * >( round_up( reinterpret_cast< std::uintptr_t >( map_base_ ), page_bytes_ ) );
+
+  // Every page starts on the free-page stack, lowest address on top
+  pages_.resize( page_count );
+  for ( std::size_t i = page_count; i-- > 0; ) {
+    pages_[i] = Page{ nullptr, kNone, 0, 0, kNone, free_pages_, false };
+    free_pages_ = static_cast< std::uint32_t >( i );
+  }
+  free_page_count_ = page_count;
+  live_.assign( ( page_count * page_bytes_ / kGranule + 63 ) / 64, std::uint64_t{ 0 } );
+}
+
+SizeClassHeap::~SizeClassHeap() noexcept { munmap( map_base_, map_bytes_ ); }
+
+void * SizeClassHeap::allocate( std::size_t size ) {
+  if ( size == 0 || size > classes_.back().size ) {
+    throw std::bad_alloc();
+  }
+  std::lock_guard< std::mutex > lock( mtx_ );
+  SizeClass &                   sc = classes_[class_of_[( size + kGranule - 1 ) / kGranule]];
+
+  std::uint32_t page = sc.partial;
+  if ( page == kNone ) {
+    // Take a page from the shared stack and give it to this class
+    if ( free_pages_ == kNone ) {
+      throw std::bad_alloc();
+    }
+    page        = free_pages_;
+    Page & pd   = pages_[page];
+    free_pages_ = pd.next;
+    --free_page_count_;
+    pd.free_list = nullptr;
+    pd.cls       = static_cast< std::uint32_t >( &sc - classes_.data() );
+    pd.free      = sc.capacity;
+    pd.bump      = 0;
+    ++sc.pages;
+    push_partial( sc, page );
+  }
+
+  Page &      pd = pages_[page];
+  std::byte * block;
+  if ( pd.free_list ) {
+    block        = reinterpret_cast< std::byte * >( pd.free_list );
+    pd.free_list = pd.free_list->next;
+  }
+  else {
+    // Carve lazily so untouched blocks of the page are never faulted in
+    block = region_ + ( std::size_t{ page } << page_shift_ ) + std::size_t{ pd.bump } * sc.size;
+    ++pd.bump;
+  }
+  pd.released = false;
+  if ( --pd.free == 0 ) {
+    unlink_partial( sc, page );
+  }
+  const std::size_t g = static_cast< std::size_t >( block - region_ ) / kGranule;
+  live_[g / 64] |= std::uint64_t{ 1 } << ( g % 64 );
+  return block;
+}
+
+void SizeClassHeap::deallocate( void * p ) {
+  if ( !p ) {
+    return;
+  }
+  auto *                        block = static_cast< std::byte * >( p );
+  std::lock_guard< std::mutex > lock( mtx_ );
+  const std::size_t             off = static_cast< std::size_t >( block - region_ );
+  if ( block < region_ || off >= pages_.size() * page_bytes_ ) {
+    throw std::runtime_error( "SizeClassHeap::deallocate: pointer does not belong to this heap" );
+  }
+  const auto        page = static_cast< std::uint32_t >( off >> page_shift_ );
+  Page &            pd   = pages_[page];
+  const std::size_t g    = off / kGranule;
+  if ( pd.cls == kNone || ( off & ( page_bytes_ - 1 ) ) % classes_[pd.cls].size != 0 ||
+       ( ( live_[g / 64] >> ( g % 64 ) ) & 1u ) == 0 ) {
+    throw std::runtime_error( "SizeClassHeap::deallocate: double free or invalid pointer" );
+  }
+  live_[g / 64] &= ~( std::uint64_t{ 1 } << ( g % 64 ) );
+
+  SizeClass & sc   = classes_[pd.cls];
+  auto *      node = reinterpret_cast< FreeNode * >( block );
+  node->next       = pd.free_list;
+  pd.free_list     = node;
+  if ( pd.free++ == 0 ) {
+    push_partial( sc, page );
+  }
+  if ( pd.free == sc.capacity ) {
+    // Empty: hand the page back for any class to use
+    unlink_partial( sc, page );
+    --sc.pages;
+    pd.cls      = kNone;
+    pd.next     = free_pages_;
+    free_pages_ = page;
+    ++free_page_count_;
+  }
+}
+
+std::size_t SizeClassHeap::trim() {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  std::size_t                   released = 0;
+  for ( std::uint32_t page = free_pages_; page != kNone; page = pages_[page].next ) {
+    Page & pd = pages_[page];
+    if ( !pd.released && madvise( region_ + ( std::size_t{ page } << page_shift_ ), page_bytes_, MADV_DONTNEED ) == 0 ) {
+      pd.released = true;
+      released += page_bytes_;
+    }
+  }
+  return released;
+}
+
+std::size_t SizeClassHeap::block_size_of( const void * p ) const {
+  const auto *                  block = static_cast< const std::byte * >( p );
+  std::lock_guard< std::mutex > lock( mtx_ );
+  const std::size_t             off = static_cast< std::size_t >( block - region_ );
+  if ( block < region_ || off >= pages_.size() * page_bytes_ || pages_[off >> page_shift_].cls == kNone ) {
+    throw std::runtime_error( "SizeClassHeap::block_size_of: pointer does not belong to this heap" );
+  }
+  return classes_[pages_[off >> page_shift_].cls].size;
+}
+
+std::size_t SizeClassHeap::class_pages( std::size_t c ) const noexcept {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  return classes_[c].pages;
+}
+
+std::size_t SizeClassHeap::free_pages() const noexcept {
+  std::lock_guard< std::mutex > lock( mtx_ );
+  return free_page_count_;
+}
+
+void SizeClassHeap::unlink_partial( SizeClass & sc, std::uint32_t page ) noexcept {
+  Page & pd = pages_[page];
+  if ( pd.prev != kNone ) {
+    pages_[pd.prev].next = pd.next;
+  }
+  else {
+    sc.partial = pd.next;
+  }
+  if ( pd.next != kNone ) {
+    pages_[pd.next].prev = pd.prev;
+  }
+  pd.prev = pd.next = kNone;
+}
+
+void SizeClassHeap::push_partial( SizeClass & sc, std::uint32_t page ) noexcept {
+  Page & pd = pages_[page];
+  pd.prev   = kNone;
+  pd.next   = sc.partial;
+  if ( sc.partial != kNone ) {
+    pages_[sc.partial].prev = page;
+  }
+  sc.partial = page;
+}
+
+} // namespace mem
@@ -0,0 +1,669 @@
+#include "block_allocator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Kernel 6.4+ feature; older userspace headers lack the name, the kernel still negotiates it at runtime
+#if defined( UFFDIO_WRITEPROTECT_MODE_WP ) && !defined( UFFD_FEATURE_WP_UNPOPULATED )
+  #define UFFD_FEATURE_WP_UNPOPULATED ( 1 << 13 )
+#endif
+
+namespace mem {
+
+namespace {
+
+constexpr char kSnapshotMagic[8] = { 'M', 'E', 'M', 'S', 'N', 'A', 'P', '1' };
+
+// File layout: header, occupancy words, then block_count * stride bytes of block contents
+struct SnapshotHeader {
+  char          magic[8];
+  std::uint64_t block_size;
+  std::uint64_t block_count;
+  std::uint64_t alignment;
+  std::uint64_t stride;
+  std::uint64_t max_blocks;
+  std::uint64_t occupancy_words;
+  std::uint64_t data_bytes;
+};
+
+constexpr std::size_t kStreamPages = 16; // pages copied and un-protected per ioctl by the streaming thread
+
+std::size_t snapshot_page_size() noexcept { return static_cast< std::size_t >( sysconf( _SC_PAGESIZE ) ); }
+
+// Snapshot output, written under a temporary name and renamed over the target only once complete,
+// so a failed or rejected snapshot never truncates a file another snapshot is writing
+class SnapshotFile {
+public:
+  explicit SnapshotFile( const std::string & path )
+      : path_{ path }, tmp_{ path + ".tmp." + std::to_string( getpid() ) + "." + std::to_string( next_suffix() ) } {
+    out_.open( tmp_, std::ios::binary | std::ios::trunc );
+    if ( !out_ ) {
+      throw std::runtime_error( "BlockAllocator::snapshot: cannot open " + path );
+    }
+  }
+
+  SnapshotFile( const SnapshotFile & )             = delete;
+  SnapshotFile & operator=( const SnapshotFile & ) = delete;
+
+  ~SnapshotFile() {
+    if ( !committed_ ) {
+      out_.close();
+      std::remove( tmp_.c_str() );
+    }
+  }
+
+  std::ofstream & stream() noexcept { return out_; }
+
+  void commit() {
+    out_.close();
+    if ( out_.fail() || std::rename( tmp_.c_str(), path_.c_str() ) != 0 ) {
+      throw std::runtime_error( "BlockAllocator::snapshot: cannot write " + path_ );
+    }
+    committed_ = true;
+  }
+
+private:
+  static std::uint64_t next_suffix() noexcept {
+    static std::atomic< std::uint64_t > counter{ 0 };
+    return counter.fetch_add( 1, std::memory_order_relaxed );
+  }
+
+  const std::string path_;
+  const std::string tmp_;
+  std::ofstream     out_;
+  bool              committed_ = false;
+};
+
+// userfaultfd negotiated for @p features, or -1
+int open_userfaultfd( std::uint64_t features ) noexcept {
+  int fd = -1;
+#ifdef UFFD_USER_MODE_ONLY
+  // Our faults come from user space, which is all an unprivileged process may ask for
+  fd = static_cast< int >( syscall( SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY ) );
+#endif
+  if ( fd < 0 ) {
+    fd = static_cast< int >( syscall( SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK ) );
+  }
+  if ( fd < 0 ) {
+    return -1;
+  }
+  uffdio_api api{};
+  api.api      = UFFD_API;
+  api.features = features;
+  if ( ioctl( fd, UFFDIO_API, &api ) != 0 ) {
+    close( fd );
+    return -1;
+  }
+  return fd;
+}
+
+// userfaultfd that can write-protect anonymous memory, including never-touched pages, or -1
+int open_wp_userfaultfd() noexcept {
+#ifdef UFFDIO_WRITEPROTECT_MODE_WP
+  return open_userfaultfd( UFFD_FEATURE_PAGEFAULT_FLAG_WP | UFFD_FEATURE_WP_UNPOPULATED );
+#else
+  return -1;
+#endif
+}
+
+// Wake a thread waiting on the handler after the page it wants was filled by someone else
+void wake_range( int uffd, std::byte * start, std::size_t len ) noexcept {
+  uffdio_range range{ reinterpret_cast< std::uintptr_t >( start ), len };
+  ioctl( uffd, UFFDIO_WAKE, &range );
+}
+
+#ifdef UFFDIO_WRITEPROTECT_MODE_WP
+bool set_write_protect( int uffd, std::byte * start, std::size_t len, bool on ) noexcept {
+  uffdio_writeprotect wp{};
+  wp.range.start = reinterpret_cast< std::uintptr_t >( start );
+  wp.range.len   = len;
+  wp.mode        = on ? UFFDIO_WRITEPROTECT_MODE_WP : 0; // clearing also wakes writers stalled on the range
+  return ioctl( uffd, UFFDIO_WRITEPROTECT, &wp ) == 0;
+}
+
+bool register_write_protect( int uffd, std::byte * start, std::size_t len ) noexcept {
+  uffdio_register reg{};
+  reg.range.start = reinterpret_cast< std::uintptr_t >( start );
+  reg.range.len   = len;
+  reg.mode        = UFFDIO_REGISTER_MODE_WP;
+  if ( ioctl( uffd, UFFDIO_REGISTER, &reg ) != 0 ) {
+    return false;
+  }
+  if ( !set_write_protect( uffd, start, len, true ) ) {
+    ioctl( uffd, UFFDIO_UNREGISTER, &reg.range );
+    return false;
+  }
+  return true;
+}
+
+void unregister_write_protect( int uffd, std::byte * start, std::size_t len ) noexcept {
+  uffdio_range range{ reinterpret_cast< std::uintptr_t >( start ), len };
+  set_write_protect( uffd, start, len, false );
+  ioctl( uffd, UFFDIO_UNREGISTER, &range );
+}
+
+// Pages of a write-protected range, captured exactly once: by the streamer in order, or early by the
+// fault handler when a writer gets to them first
+class PageCapture {
+public:
+  PageCapture( int uffd, std::byte * base, std::size_t pages, std::size_t page )
+      : uffd_{ uffd }, base_{ base }, page_{ page }, captured_( pages, false ), early_count_{ 0 } {}
+
+  // Fault handler: copy the page aside, then let the writer through
+  void on_write_fault( std::uintptr_t addr ) {
+    const std::size_t             i = ( addr - reinterpret_cast< std::uintptr_t >( base_ ) ) / page_;
+    std::lock_guard< std::mutex > lock( mtx_ );
+    if ( i < captured_.size() && !captured_[i] ) {
+      std::vector< std::byte > copy( base_ + i * page_, base_ + ( i + 1 ) * page_ );
+      captured_[i] = true;
+      early_.emplace( i, std::move( copy ) );
+      ++early_count_;
+    }
+    // Also wakes a writer whose fault raced with the streamer releasing the page
+    set_write_protect( uffd_, base_ + i * page_, page_, false );
+  }
+
+  // Streamer: fill @p out with pages [first, first + n) as of the protection point and release them
+  void take( std::size_t first, std::size_t n, std::byte * out ) {
+    std::lock_guard< std::mutex > lock( mtx_ );
+    for ( std::size_t i = first; i < first + n; ++i ) {
+      std::byte * dst = out + ( i - first ) * page_;
+      if ( !captured_[i] ) {
+        std::memcpy( dst, base_ + i * page_, page_ );
+        captured_[i] = true;
+      }
+      else {
+        auto it = early_.find( i );
+        std::memcpy( dst, it->second.data(), page_ );
+        early_.erase( it );
+      }
+    }
+    set_write_protect( uffd_, base_ + first * page_, n * page_, false );
+  }
+
+  std::size_t early_count() const noexcept { return early_count_; }
+
+private:
+  const int                                                   uffd_;
+  std::byte * const                                           base_;
+  const std::size_t                                           page_;
+  std::mutex                                                  mtx_;
+  std::vector< bool >                                         captured_;
+  std::unordered_map< std::size_t, std::vector< std::byte > > early_; // copied for a writer, not yet streamed
+  std::size_t                                                 early_count_;
+};
+#else
+bool register_write_protect( int, std::byte *, std::size_t ) noexcept { return false; }
+#endif
+
+void signal_stop( int fd ) noexcept {
+  const char stop = 1;
+  while ( write( fd, &stop, 1 ) < 0 && errno == EINTR ) {
+  }
+}
+
+// Read up to @p n bytes at @p offset; the rest of @p out is zeroed if the file ends or fails early
+void read_page( int fd, std::byte * out, std::size_t n, off_t offset ) noexcept {
+  std::size_t got = 0;
+  while ( got < n ) {
+    const ssize_t r = pread( fd, out + got, n - got, offset + static_cast< off_t >( got ) );
+    if ( r < 0 && errno == EINTR ) {
+      continue;
+    }
+    if ( r <= 0 ) {
+      break;
+    }
+    got += static_cast< std::size_t >( r );
+  }
+  std::memset( out + got, 0, n - got );
+}
+
+void write_all( std::ofstream & out, const void * data, std::size_t n, const std::string & path ) {
+  out.write( static_cast< const char * >( data ), static_cast< std::streamsize >( n ) );
+  if ( !out ) {
+    throw std::runtime_error( "BlockAllocator::snapshot: cannot write " + path );
+  }
+}
+
+} // namespace
+
+// Missing-page registration of a lazily restored region. Each page is filled exactly once, by the
+// fault handler when a thread touches it first or by the prefetcher walking the region in order;
+// whichever loses gets EEXIST. Free blocks (as of the snapshot) are filled with zeros, so the pool
+// can keep them parked without touching them, and pages holding no allocated block are never read.
+struct BlockAllocator::LazyRestore {
+  LazyRestore( int uffd_fd, int file_fd, off_t data_offset, std::byte * region, std::size_t range, std::size_t page_size,
+               std::size_t block_stride, std::size_t block_count, std::vector< std::uint64_t > live_bits,
+               std::atomic< bool > & restoring )
+      : uffd{ uffd_fd }, file{ file_fd }, data_off{ data_offset }, base{ region }, bytes{ range }, page{ page_size },
+        stride{ block_stride }, blocks{ block_count }, occupancy{ std::move( live_bits ) }, pending{ range / page_size },
+        done( ( range / page_size + 63 ) / 64 ), active{ restoring } {}
+
+  ~LazyRestore() {
+    stop.store( true, std::memory_order_relaxed );
+    if ( handler.joinable() ) {
+      signal_stop( stop_pipe[1] );
+      handler.join();
+    }
+    if ( prefetcher.joinable() ) {
+      prefetcher.join();
+    }
+    if ( active.load( std::memory_order_relaxed ) ) {
+      // Pages not filled yet become ordinary zero-fill pages
+      uffdio_range range{ reinterpret_cast< std::uintptr_t >( base ), bytes };
+      ioctl( uffd, UFFDIO_UNREGISTER, &range );
+      active.store( false, std::memory_order_release );
+    }
+    for ( int fd : { stop_pipe[0], stop_pipe[1], uffd, file } ) {
+      if ( fd >= 0 ) {
+        close( fd );
+      }
+    }
+  }
+
+  bool live( std::size_t block ) const noexcept { return ( occupancy[block / 64] >> ( block % 64 ) ) & 1; }
+
+  bool filled( std::size_t i ) const noexcept { return ( done[i / 64].load( std::memory_order_acquire ) >> ( i % 64 ) ) & 1; }
+
+  // Record page @p i as present; the handler and the prefetcher may both report it, but it is counted once
+  void mark_filled( std::size_t i ) noexcept {
+    const std::uint64_t bit = std::uint64_t{ 1 } << ( i % 64 );
+    if ( ( done[i / 64].fetch_or( bit, std::memory_order_acq_rel ) & bit ) == 0 ) {
+      pending.fetch_sub( 1, std::memory_order_relaxed );
+    }
+  }
+
+  // Contents of page @p i into @p buf (live blocks from the file, the rest zero); false if it holds no live block
+  bool load( std::size_t i, std::byte * buf ) const noexcept {
+    const std::size_t lo   = i * page;
+    const std::size_t hi   = lo + page;
+    const std::size_t last = std::min( blocks, ( hi + stride - 1 ) / stride );
+    bool              any  = false;
+    for ( std::size_t b = lo / stride; b < last && !any; ++b ) {
+      any = live( b );
+    }
+    if ( !any ) {
+      return false;
+    }
+    const std::size_t end = std::min( hi, blocks * stride );
+    read_page( file, buf, end - lo, data_off + static_cast< off_t >( lo ) );
+    std::memset( buf + ( end - lo ), 0, hi - end );
+    for ( std::size_t b = lo / stride; b < last; ++b ) {
+      if ( !live( b ) ) {
+        const std::size_t from = std::max( lo, b * stride );
+        std::memset( buf + ( from - lo ), 0, std::min( hi, ( b + 1 ) * stride ) - from );
+      }
+    }
+    return true;
+  }
+
+  // Fill page @p i unless it is already there; @p buf is one page of scratch. false on an error other than EEXIST.
+  bool fill( std::size_t i, std::byte * buf ) noexcept {
+    if ( filled( i ) ) {
+      return true;
+    }
+    const std::size_t lo  = i * page;
+    const bool        any = load( i, buf );
+    int               rc;
+    do { // EAGAIN: the address space changed under the ioctl
+      if ( any ) {
+        uffdio_copy copy{};
+        copy.dst  = reinterpret_cast< std::uintptr_t >( base + lo );
+        copy.src  = reinterpret_cast< std::uintptr_t >( buf );
+        copy.len  = page;
+        copy.mode = 0;
+        rc        = ioctl( uffd, UFFDIO_COPY, &copy );
+      }
+      else {
+        uffdio_zeropage zero{};
+        zero.range.start = reinterpret_cast< std::uintptr_t >( base + lo );
+        zero.range.len   = page;
+        rc               = ioctl( uffd, UFFDIO_ZEROPAGE, &zero );
+      }
+    } while ( rc != 0 && errno == EAGAIN );
+    if ( rc != 0 && errno != EEXIST ) {
+      // Leave the faulting thread stalled: the prefetcher falls back to copy_remaining(), which wakes it
+      return false;
+    }
+    if ( rc != 0 ) {
+      // Filled by the other thread first; the fault we were asked to serve may still be waiting
+      wake_range( uffd, base + lo, page );
+    }
+    mark_filled( i );
+    return true;
+  }
+
+  // Fallback after a failed fill, once the handler has stopped: put the missing pages in place
+  // while the range is still registered, so a thread stalled on one of them wakes to its contents,
+  // then unregister. Runs of missing pages are built in a scratch mapping and moved over the
+  // region, as adopt_slabs_unlocked() moves donated slabs; only if that fails are they copied after
+  // unregistering, where a thread touching one first would read zeros.
+  void copy_remaining( std::byte * buf ) noexcept {
+    const std::size_t pages = bytes / page;
+
+    void * scratch = mmap( nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+    if ( scratch != MAP_FAILED ) {
+      auto * const from = static_cast< std::byte * >( scratch );
+      for ( std::size_t i = 0; i < pages; ) {
+        std::size_t end = i;
+        for ( ; end < pages && !filled( end ); ++end ) {
+          load( end, from + end * page );
+        }
+        const std::size_t len = ( end - i ) * page;
+        if ( len != 0 && mremap( from + i * page, len, len, MREMAP_MAYMOVE | MREMAP_FIXED, base + i * page ) != MAP_FAILED ) {
+          for ( ; i < end; ++i ) {
+            mark_filled( i );
+          }
+        }
+        i = end + 1;
+      }
+      munmap( scratch, bytes );
+      // A moved-in run is no longer registered, so unregistering alone would not wake its waiters
+      wake_range( uffd, base, bytes );
+    }
+    uffdio_range range{ reinterpret_cast< std::uintptr_t >( base ), bytes };
+    ioctl( uffd, UFFDIO_UNREGISTER, &range );
+    for ( std::size_t i = 0; i < pages; ++i ) {
+      if ( !filled( i ) ) {
+        if ( load( i, buf ) ) {
+          std::memcpy( base + i * page, buf, page );
+        }
+        mark_filled( i );
+      }
+    }
+  }
+
+  void start() {
+    if ( pipe2( stop_pipe, O_CLOEXEC ) != 0 ) {
+      throw std::runtime_error( "BlockAllocator::restore: cannot create the fault handler pipe" );
+    }
+    handler = std::thread( [this] {
+      std::vector< std::byte > buf( page );
+      pollfd                   fds[2] = { { uffd, POLLIN, 0 }, { stop_pipe[0], POLLIN, 0 } };
+      for ( ;; ) {
+        if ( poll( fds, 2, -1 ) < 0 && errno != EINTR ) {
+          handler_done.store( true, std::memory_order_release );
+          return;
+        }
+        uffd_msg msg;
+        while ( read( uffd, &msg, sizeof msg ) == static_cast< ssize_t >( sizeof msg ) ) {
+          if ( msg.event == UFFD_EVENT_PAGEFAULT ) {
+            const auto addr = static_cast< std::uintptr_t >( msg.arg.pagefault.address );
+            fill( ( addr - reinterpret_cast< std::uintptr_t >( base ) ) / page, buf.data() );
+          }
+        }
+        if ( fds[1].revents != 0 ) {
+          handler_done.store( true, std::memory_order_release );
+          return;
+        }
+      }
+    } );
+    prefetcher = std::thread( [this] {
+      std::vector< std::byte > buf( page );
+      bool                     ok = true;
+      for ( std::size_t i = 0; i < bytes / page && ok; ++i ) {
+        if ( stop.load( std::memory_order_relaxed ) ) {
+          return;
+        }
+        ok = fill( i, buf.data() );
+      }
+      if ( ok && pending.load( std::memory_order_relaxed ) == 0 ) {
+        // Every page is resident: the region is an ordinary mapping again
+        uffdio_range range{ reinterpret_cast< std::uintptr_t >( base ), bytes };
+        ioctl( uffd, UFFDIO_UNREGISTER, &range );
+      }
+      else {
+        // A fill failed here or in the handler: stop serving faults and finish eagerly
+        signal_stop( stop_pipe[1] );
+        while ( !handler_done.load( std::memory_order_acquire ) ) {
+          if ( stop.load( std::memory_order_relaxed ) ) {
+            return;
+          }
+          std::this_thread::yield();
+        }
+        copy_remaining( buf.data() );
+      }
+      active.store( false, std::memory_order_release );
+      signal_stop( stop_pipe[1] );
+    } );
+  }
+
+  const int                                   uffd;
+  const int                                   file;
+  const off_t                                 data_off; // where block contents start in the file
+  std::byte * const                           base;
+  const std::size_t                           bytes; // registered range, whole pages
+  const std::size_t                           page;
+  const std::size_t                           stride;
+  const std::size_t                           blocks; // block count recorded in the snapshot
+  const std::vector< std::uint64_t >          occupancy;
+  std::atomic< std::size_t >                  pending; // pages not filled yet
+  std::vector< std::atomic< std::uint64_t > > done; // bit per page: present, filled by either thread
+  std::atomic< bool > &                       active; // the pool's restoring_
+  std::atomic< bool >                         stop{ false };
+  std::atomic< bool >                         handler_done{ false }; // handler thread no longer filling pages
+  int                                         stop_pipe[2] = { -1, -1 };
+  std::thread                                 handler;
+  std::thread                                 prefetcher;
+};
+
+SnapshotStats BlockAllocator::snapshot( const std::string & path, SnapshotMethod method ) {
+  SnapshotFile    file( path );
+  std::ofstream & out = file.stream();
+
+  const int uffd = method == SnapshotMethod::Pause ? -1 : open_wp_userfaultfd();
+  if ( uffd < 0 && method == SnapshotMethod::WriteProtect ) {
+    throw std::runtime_error( "BlockAllocator::snapshot: userfaultfd write-protection is unavailable" );
+  }
+
+  // Metadata is copied, and the contents frozen, under one short critical section
+  const std::size_t            page = snapshot_page_size();
+  SnapshotHeader               header{};
+  std::vector< std::uint64_t > occupancy;
+  std::vector< std::byte >     paused_copy;
+  std::size_t                  range           = 0;
+  bool                         write_protected = false;
+  {
+    std::lock_guard< std::mutex > lock( mtx_ );
+    if ( snapshot_active_ ) {
+      if ( uffd >= 0 ) {
+        close( uffd );
+      }
+      throw std::logic_error( "BlockAllocator::snapshot: a snapshot is already running" );
+    }
+    std::memcpy( header.magic, kSnapshotMagic, sizeof kSnapshotMagic );
+    header.block_size      = block_size_;
+    header.block_count     = block_count_;
+    header.alignment       = alignment_;
+    header.stride          = stride_;
+    header.max_blocks      = max_blocks_;
+    header.occupancy_words = occupancy_.size();
+    header.data_bytes      = block_count_ * stride_;
+    occupancy              = occupancy_;
+
+    range           = round_up( block_count_ * stride_, page );
+    write_protected = uffd >= 0 && register_write_protect( uffd, region_, range );
+    if ( !write_protected && method == SnapshotMethod::WriteProtect ) {
+      close( uffd );
+      throw std::runtime_error( "BlockAllocator::snapshot: cannot write-protect the pool region" );
+    }
+    if ( write_protected ) {
+      snapshot_active_ = true;
+    }
+    else {
+      paused_copy.assign( region_, region_ + block_count_ * stride_ );
+    }
+  }
+  if ( uffd >= 0 && !write_protected ) {
+    close( uffd );
+  }
+
+  SnapshotStats stats{ sizeof header + occupancy.size() * sizeof( std::uint64_t ) + header.data_bytes, 0,
+                       write_protected ? SnapshotMethod::WriteProtect : SnapshotMethod::Pause };
+  if ( !write_protected ) {
+    write_all( out, &header, sizeof header, path );
+    write_all( out, occupancy.data(), occupancy.size() * sizeof( std::uint64_t ), path );
+    write_all( out, paused_copy.data(), paused_copy.size(), path );
+    file.commit();
+    return stats;
+  }
+
+#ifdef UFFDIO_WRITEPROTECT_MODE_WP
+  int stop_pipe[2];
+  if ( pipe2( stop_pipe, O_CLOEXEC ) != 0 ) {
+    stop_pipe[0] = stop_pipe[1] = -1;
+  }
+  PageCapture capture( uffd, region_, range / page, page );
+  std::thread handler;
+  if ( stop_pipe[0] >= 0 ) {
+    handler = std::thread( [&capture, uffd, stop_fd = stop_pipe[0]] {
+      pollfd fds[2] = { { uffd, POLLIN, 0 }, { stop_fd, POLLIN, 0 } };
+      for ( ;; ) {
+        if ( poll( fds, 2, -1 ) < 0 && errno != EINTR ) {
+          return;
+        }
+        uffd_msg msg;
+        while ( read( uffd, &msg, sizeof msg ) == static_cast< ssize_t >( sizeof msg ) ) {
+          if ( msg.event == UFFD_EVENT_PAGEFAULT ) {
+            capture.on_write_fault( static_cast< std::uintptr_t >( msg.arg.pagefault.address ) );
+          }
+        }
+        if ( fds[1].revents != 0 ) {
+          return;
+        }
+      }
+    } );
+  }
+
+  auto finish = [&] {
+    // Lifting the protection everywhere wakes any writer still stalled, even if streaming failed
+    unregister_write_protect( uffd, region_, range );
+    if ( handler.joinable() ) {
+      signal_stop( stop_pipe[1] );
+      handler.join();
+    }
+    for ( int fd : { stop_pipe[0], stop_pipe[1], uffd } ) {
+      if ( fd >= 0 ) {
+        close( fd );
+      }
+    }
+    std::lock_guard< std::mutex > lock( mtx_ );
+    snapshot_active_ = false;
+  };
+
+  try {
+    if ( !handler.joinable() ) {
+      throw std::runtime_error( "BlockAllocator::snapshot: cannot start the fault handler" );
+    }
+    write_all( out, &header, sizeof header, path );
+    write_all( out, occupancy.data(), occupancy.size() * sizeof( std::uint64_t ), path );
+    std::vector< std::byte > chunk( kStreamPages * page );
+    for ( std::size_t first = 0; first * page < header.data_bytes; first += kStreamPages ) {
+      const std::size_t n = std::min( kStreamPages, range / page - first );
+      capture.take( first, n, chunk.data() );
+      write_all( out, chunk.data(), std::min( n * page, header.data_bytes - first * page ), path );
+    }
+    file.commit();
+  } catch ( ... ) {
+    finish();
+    throw;
+  }
+  finish();
+  stats.pages_copied_early = capture.early_count();
+#endif
+  return stats;
+}
+
+std::unique_ptr< BlockAllocator > BlockAllocator::restore( const std::string & path, const BlockAllocatorOptions & options,
+                                                           RestoreMode mode ) {
+  std::ifstream in( path, std::ios::binary );
+  if ( !in ) {
+    throw std::runtime_error( "BlockAllocator::restore: cannot open " + path );
+  }
+  SnapshotHeader header{};
+  if ( !in.read( reinterpret_cast< char * >( &header ), sizeof header ) ||
+       std::memcmp( header.magic, kSnapshotMagic, sizeof kSnapshotMagic ) != 0 ) {
+    throw std::runtime_error( "BlockAllocator::restore: " + path + " is not a pool snapshot" );
+  }
+  if ( header.block_count == 0 || header.block_count > header.max_blocks ||
+       header.occupancy_words != ( header.max_blocks + 63 ) / 64 || header.data_bytes != header.block_count * header.stride ) {
+    throw std::runtime_error( "BlockAllocator::restore: " + path + " has an inconsistent header" );
+  }
+
+  BlockAllocatorOptions pool_options = options;
+  pool_options.reserve_blocks        = std::max( pool_options.reserve_blocks, static_cast< std::size_t >( header.max_blocks ) );
+  auto pool = std::make_unique< BlockAllocator >( static_cast< std::size_t >( header.block_size ),
+                                                  static_cast< std::size_t >( header.block_count ),
+                                                  static_cast< std::size_t >( header.alignment ), pool_options );
+  if ( pool->stride_ != header.stride ) {
+    throw std::runtime_error( "BlockAllocator::restore: " + path + " was written with a different block layout" );
+  }
+
+  const auto occupancy_bytes = static_cast< std::streamsize >( header.occupancy_words * sizeof( std::uint64_t ) );
+  const auto data_bytes      = static_cast< std::streamsize >( header.data_bytes );
+  const auto data_offset     = static_cast< off_t >( sizeof header ) + static_cast< off_t >( occupancy_bytes );
+
+  std::lock_guard< std::mutex > lock( pool->mtx_ );
+  if ( !in.read( reinterpret_cast< char * >( pool->occupancy_.data() ), occupancy_bytes ) ) {
+    throw std::runtime_error( "BlockAllocator::restore: " + path + " is truncated" );
+  }
+
+  if ( mode == RestoreMode::Lazy ) {
+    const int file = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    struct stat st{};
+    if ( file < 0 || fstat( file, &st ) != 0 || st.st_size < data_offset + static_cast< off_t >( data_bytes ) ) {
+      if ( file >= 0 ) {
+        close( file );
+      }
+      throw std::runtime_error( "BlockAllocator::restore: " + path + " is truncated" );
+    }
+
+    // The region is fresh, so every page in it is still missing
+    const std::size_t range = pool->committed_bytes_;
+    const int         uffd  = open_userfaultfd( 0 );
+    uffdio_register   reg{};
+    reg.range.start         = reinterpret_cast< std::uintptr_t >( pool->region_ );
+    reg.range.len           = range;
+    reg.mode                = UFFDIO_REGISTER_MODE_MISSING;
+    if ( uffd >= 0 && ioctl( uffd, UFFDIO_REGISTER, &reg ) == 0 ) {
+      pool->restoring_.store( true, std::memory_order_relaxed );
+      pool->lazy_restore_ = std::make_shared< LazyRestore >( uffd, file, data_offset, pool->region_, range, snapshot_page_size(),
+                                                             pool->stride_, static_cast< std::size_t >( header.block_count ),
+                                                             pool->occupancy_, pool->restoring_ );
+      pool->lazy_restore_->start();
+      pool->park_free_blocks_unlocked();
+      return pool;
+    }
+    // No userfaultfd: read everything now
+    if ( uffd >= 0 ) {
+      close( uffd );
+    }
+    close( file );
+  }
+
+  if ( !in.read( reinterpret_cast< char * >( pool->region_ ), data_bytes ) ) {
+    throw std::runtime_error( "BlockAllocator::restore: " + path + " is truncated" );
+  }
+  pool->rebuild_free_list_unlocked();
+  return pool;
+}
+
+std::size_t BlockAllocator::restore_pages_pending() const noexcept {
+  return lazy_restore_ ? lazy_restore_->pending.load( std::memory_order_relaxed ) : 0;
+}
+
+} // namespace mem
@@ -1,13 +1,37 @@
 #include "block_allocator.hpp"
+#include "clock_cache.hpp"
+#include "memory_budget.hpp"
+#include "monotonic_arena.hpp"
+#include "page_map.hpp"
+#include "page_pool.hpp"
+#include "pressure_monitor.hpp"
+#include "segmented_vector.hpp"
+#include "signal_safe_pool.hpp"
+#include "size_class_heap.hpp"
+#include "slot_map.hpp"
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
+#include <memory>
 #include <random>
+#include <sstream>
+#include <string>
 #include <thread>
 #include <vector>
 
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
 using mem::BlockAllocator;
 
 TEST( BlockAllocator, BasicAllocateFree ) {
@@ -126,3 +150,1296 @@ TEST( BlockAllocator, StressWithContentionAndOOM ) {
   EXPECT_EQ( alloc.free_blocks(), blocks );
   EXPECT_GT( allocations.load(), 0 );
 }
+
+TEST( BlockAllocator, AllocateAllIsAllOrNothing ) {
+  BlockAllocator alloc( 32, 4, 32 );
+  void *         blocks[4] = {};
+
+  std::size_t available = 0;
+  EXPECT_FALSE( alloc.allocate_all( blocks, 5, &available ) );
+  EXPECT_EQ( available, 4u );
+  EXPECT_EQ( alloc.free_blocks(), 4u );
+
+  ASSERT_TRUE( alloc.allocate_all( blocks, 3 ) );
+  EXPECT_EQ( alloc.free_blocks(), 1u );
+  EXPECT_FALSE( alloc.allocate_all( blocks + 3, 2, &available ) );
+  EXPECT_EQ( available, 1u );
+  EXPECT_EQ( alloc.free_blocks(), 1u );
+
+  for ( int i = 0; i < 3; ++i )
+    alloc.deallocate( blocks[i] );
+  EXPECT_EQ( alloc.free_blocks(), 4u );
+}
+
+TEST( BlockAllocator, AllocateAllForWaitsForEnoughBlocks ) {
+  BlockAllocator alloc( 32, 4, 32 );
+  void *         held[4] = {};
+  ASSERT_TRUE( alloc.allocate_all( held, 4 ) );
+
+  EXPECT_FALSE( alloc.allocate_all_for( held, 2, std::chrono::milliseconds( 5 ) ) );
+  EXPECT_FALSE( alloc.allocate_all_for( held, 5, std::chrono::hours( 1 ) ) );
+
+  std::thread releaser( [&]() {
+    std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    alloc.deallocate( held[0] );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    alloc.deallocate( held[1] );
+  } );
+
+  void * got[2] = {};
+  EXPECT_TRUE( alloc.allocate_all_for( got, 2, std::chrono::seconds( 10 ) ) );
+  releaser.join();
+  EXPECT_EQ( alloc.free_blocks(), 0u );
+
+  alloc.deallocate( got[0] );
+  alloc.deallocate( got[1] );
+  alloc.deallocate( held[2] );
+  alloc.deallocate( held[3] );
+  EXPECT_EQ( alloc.free_blocks(), 4u );
+}
+
+TEST( BlockAllocator, DeterministicStreamsReplay ) {
+  BlockAllocator alloc( 64, 16, 64 );
+  alloc.set_deterministic_streams( 4 );
+  EXPECT_EQ( alloc.deterministic_streams(), 4u );
+
+  // Each stream allocates three blocks, frees the middle one and allocates again
+  auto run = [&]( bool reversed ) {
+    std::vector< std::vector< void * > > seen( 4 );
+    std::vector< std::thread >           ts;
+    for ( std::uint64_t k = 0; k < 4; ++k ) {
+      const std::uint64_t key = reversed ? 3 - k : k;
+      ts.emplace_back( [&, key]() {
+        auto & mine = seen[key];
+        for ( int i = 0; i < 3; ++i )
+          mine.push_back( alloc.allocate_stream( key ) );
+        alloc.deallocate( mine[1] );
+        mine.push_back( alloc.allocate_stream( key ) );
+      } );
+      if ( reversed )
+        ts.back().join();
+    }
+    for ( auto & th : ts )
+      if ( th.joinable() )
+        th.join();
+    for ( auto & mine : seen ) {
+      alloc.deallocate( mine[0] );
+      alloc.deallocate( mine[2] );
+      alloc.deallocate( mine[3] );
+    }
+    return seen;
+  };
+
+  const auto first = run( false );
+  alloc.set_deterministic_streams( 4 ); // rewind every sub-range to address order
+  const auto second = run( true );
+  EXPECT_EQ( first, second );
+  EXPECT_EQ( first[0][3], first[0][1] );
+  EXPECT_LT( first[0][0], first[0][1] );
+  EXPECT_LT( first[0][2], first[1][0] );
+
+  // A stream never borrows from its neighbours
+  void * held[4] = {};
+  ASSERT_TRUE( alloc.allocate_all( held, 4 ) );
+  EXPECT_THROW( alloc.allocate(), std::bad_alloc );
+  void * other = alloc.allocate_stream( 1 );
+  alloc.deallocate( other );
+  for ( void * p : held )
+    alloc.deallocate( p );
+
+  EXPECT_THROW( alloc.set_deterministic_streams( 17 ), std::invalid_argument );
+  void * busy = alloc.allocate();
+  EXPECT_THROW( alloc.set_deterministic_streams( 0 ), std::logic_error );
+  alloc.deallocate( busy );
+  alloc.set_deterministic_streams( 0 );
+  EXPECT_EQ( alloc.free_blocks(), 16u );
+}
+
+TEST( SlotMap, InsertFindEraseAndIterate ) {
+  mem::SlotMap< std::string > map( 8 );
+  const auto                  a = map.insert( "alpha" );
+  const auto                  b = map.emplace( std::size_t{ 3 }, 'b' );
+  EXPECT_EQ( map.size(), 2u );
+  ASSERT_NE( map.find( a ), nullptr );
+  EXPECT_EQ( *map.find( a ), "alpha" );
+  EXPECT_EQ( *map.find( b ), "bbb" );
+
+  EXPECT_TRUE( map.erase( a ) );
+  EXPECT_FALSE( map.erase( a ) );
+  EXPECT_EQ( map.find( a ), nullptr );
+
+  // The freed slot is reused under a new generation; the stale key stays dead
+  const auto c = map.insert( "gamma" );
+  EXPECT_NE( c, a );
+  EXPECT_EQ( c & 0xFFFFFFu, a & 0xFFFFFFu );
+  EXPECT_EQ( map.find( a ), nullptr );
+  EXPECT_EQ( *map.find( c ), "gamma" );
+
+  std::vector< std::string > seen;
+  map.for_each( [&]( mem::SlotMap< std::string >::key_type key, std::string & value ) {
+    EXPECT_EQ( map.find( key ), &value );
+    seen.push_back( value );
+  } );
+  EXPECT_EQ( seen, ( std::vector< std::string >{ "gamma", "bbb" } ) );
+
+  map.clear();
+  EXPECT_TRUE( map.empty() );
+  EXPECT_EQ( map.find( b ), nullptr );
+}
+
+TEST( BlockAllocator, ReservedPoolGrowsInPlace ) {
+  mem::BlockAllocatorOptions options;
+  options.reserve_blocks = 1 << 20;
+  BlockAllocator alloc( 100, 8, 16, options );
+  EXPECT_EQ( alloc.block_count(), 8u );
+  EXPECT_EQ( alloc.max_block_count(), std::size_t{ 1 } << 20 );
+
+  std::vector< void * > ptrs;
+  for ( int i = 0; i < 5000; ++i ) {
+    void * p = alloc.allocate();
+    std::memset( p, 0x5A, 100 );
+    ptrs.push_back( p );
+  }
+  EXPECT_GE( alloc.block_count(), 5000u );
+  EXPECT_LT( alloc.block_count(), 20000u );
+
+  // Still one contiguous region: indices follow addresses
+  EXPECT_EQ( alloc.index_of( ptrs[4999] ), 4999u );
+  EXPECT_EQ( alloc.block_at( 4999 ), ptrs[4999] );
+
+  void * batch[64] = {};
+  EXPECT_TRUE( alloc.allocate_all( batch, 64 ) );
+
+  // Without streams, allocate_stream() grows past the commit like allocate()
+  const std::size_t committed = alloc.block_count();
+  while ( alloc.block_count() == committed )
+    ptrs.push_back( alloc.allocate_stream( ptrs.size() ) );
+  EXPECT_GT( alloc.block_count(), committed );
+
+  for ( void * p : batch )
+    alloc.deallocate( p );
+  for ( void * p : ptrs )
+    alloc.deallocate( p );
+  EXPECT_EQ( alloc.free_blocks(), alloc.block_count() );
+}
+
+TEST( BlockAllocator, ReservedPoolStopsAtLimit ) {
+  mem::BlockAllocatorOptions options;
+  options.reserve_blocks = 10;
+  BlockAllocator alloc( 64, 2, 64, options );
+
+  void * blocks[10] = {};
+  EXPECT_FALSE( alloc.allocate_all( blocks, 11 ) );
+  ASSERT_TRUE( alloc.allocate_all( blocks, 10 ) );
+  EXPECT_EQ( alloc.block_count(), 10u );
+  EXPECT_THROW( alloc.allocate(), std::bad_alloc );
+  for ( void * p : blocks )
+    alloc.deallocate( p );
+}
+
+TEST( BlockAllocator, AllocateZeroedAfterReuseAndRelease ) {
+  const std::size_t page = static_cast< std::size_t >( sysconf( _SC_PAGESIZE ) );
+  BlockAllocator    alloc( 256, 4 * page / 256, 64 );
+
+  auto is_zero = []( const void * p, std::size_t n ) {
+    const auto * bytes = static_cast< const unsigned char * >( p );
+    return std::all_of( bytes, bytes + n, []( unsigned char c ) { return c == 0; } );
+  };
+
+  // Dirty every block, then hand them back
+  std::vector< void * > ptrs;
+  for ( std::size_t i = 0; i < alloc.block_count(); ++i ) {
+    void * p = alloc.allocate();
+    std::memset( p, 0xAB, 256 );
+    ptrs.push_back( p );
+  }
+  for ( void * p : ptrs )
+    alloc.deallocate( p );
+
+  // Recycled blocks are cleared on demand
+  void * z = alloc.allocate_zeroed();
+  EXPECT_TRUE( is_zero( z, 256 ) );
+  alloc.deallocate( z );
+
+  // Fully free pages go back to the kernel and come back as known-zero blocks
+  EXPECT_GE( alloc.release_free_pages(), 3 * page );
+  EXPECT_EQ( alloc.free_blocks(), alloc.block_count() );
+  ptrs.clear();
+  for ( std::size_t i = 0; i < alloc.block_count(); ++i ) {
+    void * p = alloc.allocate_zeroed();
+    EXPECT_TRUE( is_zero( p, 256 ) );
+    ptrs.push_back( p );
+  }
+  EXPECT_THROW( alloc.allocate_zeroed(), std::bad_alloc );
+  std::sort( ptrs.begin(), ptrs.end() );
+  EXPECT_EQ( std::unique( ptrs.begin(), ptrs.end() ), ptrs.end() );
+  for ( void * p : ptrs )
+    alloc.deallocate( p );
+  EXPECT_EQ( alloc.free_blocks(), alloc.block_count() );
+}
+
+TEST( BlockAllocator, AllocateZeroedLargeBlocks ) {
+  BlockAllocator alloc( 64 * 1024 + 24, 2, 64 );
+  void *         p = alloc.allocate();
+  void *         r = alloc.allocate();
+  std::memset( p, 0xCD, alloc.block_size() );
+  std::memset( r, 0xCD, alloc.block_size() );
+  alloc.deallocate( p );
+  void * q = alloc.allocate_zeroed();
+  ASSERT_EQ( q, p ); // no known-zero block left, so the recycled one is cleared
+  const auto * bytes = static_cast< const unsigned char * >( q );
+  EXPECT_TRUE( std::all_of( bytes, bytes + alloc.block_size(), []( unsigned char c ) { return c == 0; } ) );
+  alloc.deallocate( q );
+  alloc.deallocate( r );
+}
+
+TEST( BlockAllocator, DeallocateBatchSplicesInAddressOrder ) {
+  BlockAllocator        alloc( 48, 300, 16 );
+  std::vector< void * > ptrs( 300 );
+  ASSERT_TRUE( alloc.allocate_all( ptrs.data(), ptrs.size() ) );
+
+  std::mt19937 rng( 42 );
+  std::shuffle( ptrs.begin(), ptrs.end(), rng );
+  alloc.deallocate_batch( ptrs.data(), ptrs.size() );
+  EXPECT_EQ( alloc.free_blocks(), 300u );
+
+  // Allocation now walks the blocks in ascending address order
+  void * prev = alloc.allocate();
+  for ( int i = 0; i < 299; ++i ) {
+    void * next = alloc.allocate();
+    EXPECT_EQ( static_cast< std::byte * >( next ) - static_cast< std::byte * >( prev ),
+               static_cast< std::ptrdiff_t >( alloc.stride() ) );
+    prev = next;
+  }
+}
+
+TEST( BlockAllocator, DeallocateBatchRejectsWholeBatch ) {
+  BlockAllocator alloc( 32, 8, 32 );
+  void *         a = alloc.allocate();
+  void *         b = alloc.allocate();
+  void *         c = alloc.allocate();
+
+  void * duplicate[] = { a, b, a };
+  EXPECT_THROW( alloc.deallocate_batch( duplicate, 3 ), std::runtime_error );
+  EXPECT_EQ( alloc.free_blocks(), 5u );
+
+  int    x;
+  void * foreign[] = { a, &x };
+  EXPECT_THROW( alloc.deallocate_batch( foreign, 2 ), std::runtime_error );
+  void * misaligned[] = { static_cast< std::byte * >( b ) + 8 };
+  EXPECT_THROW( alloc.deallocate_batch( misaligned, 1 ), std::runtime_error );
+  EXPECT_EQ( alloc.free_blocks(), 5u );
+
+  void * ok[] = { c, nullptr, a, b };
+  alloc.deallocate_batch( ok, 4 );
+  EXPECT_EQ( alloc.free_blocks(), 8u );
+  EXPECT_THROW( alloc.deallocate_batch( ok, 1 ), std::runtime_error );
+}
+
+TEST( BlockAllocator, DeallocateAsyncDrain ) {
+  BlockAllocator alloc( 64, 1024, 64 );
+
+  const int                  threads = 4;
+  std::vector< std::thread > ts;
+  for ( int t = 0; t < threads; ++t ) {
+    ts.emplace_back( [&]() {
+      // More than one buffer's worth, so back-pressure flushes kick in
+      for ( int i = 0; i < 200; ++i ) {
+        void * blocks[2] = {};
+        while ( !alloc.allocate_all( blocks, 2 ) ) {
+          alloc.drain();
+        }
+        alloc.deallocate_async( blocks[0] );
+        alloc.deallocate_async( blocks[1] );
+      }
+    } );
+  }
+  for ( auto & th : ts )
+    th.join();
+
+  EXPECT_EQ( alloc.free_blocks() + alloc.pending_frees(), 1024u );
+  alloc.drain();
+  EXPECT_EQ( alloc.pending_frees(), 0u );
+  EXPECT_EQ( alloc.free_blocks(), 1024u );
+
+  int x;
+  EXPECT_THROW( alloc.deallocate_async( &x ), std::runtime_error );
+
+  // Double frees surface at drain time without losing the valid blocks
+  void * p = alloc.allocate();
+  void * q = alloc.allocate();
+  alloc.deallocate_async( p );
+  alloc.deallocate_async( p );
+  alloc.deallocate_async( q );
+  EXPECT_THROW( alloc.drain(), std::runtime_error );
+  EXPECT_EQ( alloc.free_blocks(), 1024u );
+}
+
+TEST( BlockAllocator, BackgroundReclaimer ) {
+  BlockAllocator alloc( 64, 16, 64 );
+  alloc.start_reclaimer( std::chrono::milliseconds( 1 ) );
+  EXPECT_THROW( alloc.start_reclaimer( std::chrono::milliseconds( 1 ) ), std::logic_error );
+
+  std::vector< void * > ptrs;
+  for ( int i = 0; i < 16; ++i )
+    ptrs.push_back( alloc.allocate() );
+  for ( void * p : ptrs )
+    alloc.deallocate_async( p );
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 10 );
+  while ( alloc.free_blocks() != 16 && std::chrono::steady_clock::now() < deadline )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  EXPECT_EQ( alloc.free_blocks(), 16u );
+  EXPECT_EQ( alloc.pending_frees(), 0u );
+  alloc.stop_reclaimer();
+}
+
+TEST( MonotonicArena, BumpsWithinChunksAndReleasesAll ) {
+  BlockAllocator chunks( 4096, 4, 64 );
+  {
+    mem::MonotonicArena arena( chunks );
+    auto *              a = static_cast< std::byte * >( arena.allocate( 100, 8 ) );
+    auto *              b = static_cast< std::byte * >( arena.allocate( 10, 1 ) );
+    auto *              c = static_cast< std::byte * >( arena.allocate( 32, 32 ) );
+    EXPECT_EQ( b, a + 100 );
+    EXPECT_EQ( reinterpret_cast< std::uintptr_t >( c ) % 32, 0u );
+    EXPECT_EQ( arena.chunk_count(), 1u );
+    EXPECT_EQ( chunks.free_blocks(), 3u );
+
+    // Spills into new chunks until the pool bounds the arena
+    arena.allocate( arena.max_allocation() );
+    arena.allocate( arena.max_allocation() );
+    arena.allocate( arena.max_allocation() );
+    EXPECT_EQ( arena.chunk_count(), 4u );
+    EXPECT_THROW( arena.allocate( 1 ), std::bad_alloc );
+    EXPECT_THROW( arena.allocate( 1, 3 ), std::invalid_argument );
+
+    arena.release();
+    EXPECT_EQ( chunks.free_blocks(), 4u );
+    EXPECT_THROW( arena.allocate( arena.max_allocation() + 1 ), std::bad_alloc );
+    arena.allocate( 8 );
+    EXPECT_EQ( chunks.free_blocks(), 3u );
+  }
+  EXPECT_EQ( chunks.free_blocks(), 4u );
+
+  // The pool entry point release() uses: a chain with a repeated block frees nothing
+  void * x = chunks.allocate();
+  void * y = chunks.allocate();
+  *static_cast< void ** >( x ) = y;
+  *static_cast< void ** >( y ) = x;
+  EXPECT_THROW( chunks.deallocate_chain( x ), std::runtime_error );
+  EXPECT_EQ( chunks.free_blocks(), 2u );
+  *static_cast< void ** >( y ) = nullptr;
+  chunks.deallocate_chain( x );
+  EXPECT_EQ( chunks.free_blocks(), 4u );
+}
+
+namespace {
+// Minimal fake cgroup v2 directory for PressureMonitor tests
+struct FakeCgroup {
+  std::string dir;
+
+  FakeCgroup() {
+    char tmpl[] = "/tmp/fake_cgroupXXXXXX";
+    dir         = mkdtemp( tmpl );
+  }
+  ~FakeCgroup() {
+    std::remove( ( dir + "/memory.max" ).c_str() );
+    std::remove( ( dir + "/memory.pressure" ).c_str() );
+    rmdir( dir.c_str() );
+  }
+  void write( const std::string & name, const std::string & content ) const {
+    std::ofstream( dir + "/" + name ) << content;
+  }
+  void pressure( double some_avg10 ) const {
+    write( "memory.pressure", "some avg10=" + std::to_string( some_avg10 ) + " avg60=0.00 avg300=0.00 total=10\n" +
+                                  "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n" );
+  }
+};
+} // namespace
+
+TEST( PressureMonitor, SizesPoolsFromCgroupLimit ) {
+  FakeCgroup cg;
+  EXPECT_EQ( mem::PressureMonitor::block_count_for_limit( cg.dir, 4096, 0.5, 7 ), 7u );
+  cg.write( "memory.max", "max\n" );
+  EXPECT_EQ( mem::PressureMonitor::block_count_for_limit( cg.dir, 4096, 0.5, 7 ), 7u );
+  cg.write( "memory.max", "1048576\n" );
+  EXPECT_EQ( mem::PressureMonitor::memory_limit( cg.dir ), std::optional< std::size_t >( 1048576 ) );
+  EXPECT_EQ( mem::PressureMonitor::block_count_for_limit( cg.dir, 4096, 0.5, 7 ), 128u );
+  EXPECT_THROW( mem::PressureMonitor::block_count_for_limit( cg.dir, 0, 0.5, 7 ), std::invalid_argument );
+}
+
+TEST( PressureMonitor, TrimsWatchedPoolsWhenPressureRises ) {
+  FakeCgroup cg;
+  cg.write( "memory.max", "max\n" );
+  mem::PressureMonitor monitor( cg.dir, 20.0 );
+  EXPECT_THROW( mem::PressureMonitor( cg.dir + "/missing" ).poll(), std::runtime_error );
+
+  const std::size_t     page = static_cast< std::size_t >( sysconf( _SC_PAGESIZE ) );
+  BlockAllocator        pool( page, 8, 64 );
+  std::vector< void * > ptrs;
+  for ( int i = 0; i < 8; ++i ) {
+    ptrs.push_back( pool.allocate() );
+    std::memset( ptrs.back(), 0x11, page );
+  }
+  for ( void * p : ptrs )
+    pool.deallocate( p );
+  monitor.watch( pool );
+
+  int  shrinks    = 0;
+  bool registered = false;
+  monitor.on_pressure( [&]( const mem::PressureSample & s ) {
+    EXPECT_GE( s.some_avg10, 20.0 );
+    ++shrinks;
+    if ( !registered ) {
+      // Callbacks run outside the monitor's lock, so they may use the monitor
+      registered = true;
+      monitor.on_pressure( []( const mem::PressureSample & ) {} );
+      EXPECT_EQ( monitor.bytes_released(), 8 * page );
+    }
+  } );
+
+  cg.pressure( 1.5 );
+  EXPECT_FALSE( monitor.poll() );
+  cg.pressure( 35.0 );
+  EXPECT_TRUE( monitor.poll() );
+  EXPECT_FALSE( monitor.poll() ); // still high: edge-triggered
+  EXPECT_EQ( shrinks, 1 );
+  EXPECT_EQ( monitor.bytes_released(), 8 * page );
+  EXPECT_EQ( pool.free_blocks(), 8u );
+
+  cg.pressure( 5.0 );
+  EXPECT_FALSE( monitor.poll() );
+  cg.pressure( 25.0 );
+  EXPECT_TRUE( monitor.poll() );
+  EXPECT_EQ( shrinks, 2 );
+  monitor.unwatch( pool );
+}
+
+TEST( BlockAllocator, SampledAllocationSites ) {
+  BlockAllocator alloc( 32, 64, 32 );
+  EXPECT_TRUE( alloc.sampled_sites().empty() );
+
+  alloc.set_sample_interval( 1 );
+  std::vector< void * > ptrs;
+  for ( int i = 0; i < 6; ++i )
+    ptrs.push_back( alloc.allocate() );
+  void * other = alloc.allocate_zeroed();
+
+  auto sites = alloc.sampled_sites();
+  ASSERT_EQ( sites.size(), 2u );
+  EXPECT_EQ( sites[0].sampled_blocks, 6u );
+  EXPECT_EQ( sites[1].sampled_blocks, 1u );
+  EXPECT_FALSE( sites[0].frames.empty() );
+
+  // Freed blocks leave the table
+  for ( int i = 0; i < 4; ++i )
+    alloc.deallocate( ptrs[static_cast< std::size_t >( i )] );
+  sites = alloc.sampled_sites();
+  ASSERT_EQ( sites.size(), 2u );
+  EXPECT_EQ( sites[0].sampled_blocks + sites[1].sampled_blocks, 3u );
+
+  std::ostringstream out;
+  alloc.dump_sampled_sites( out );
+  EXPECT_NE( out.str().find( "sampled live blocks" ), std::string::npos );
+
+  // Every 4th allocation, scaled back up in the estimate
+  alloc.set_sample_interval( 0 );
+  EXPECT_TRUE( alloc.sampled_sites().empty() );
+  alloc.set_sample_interval( 4 );
+  std::vector< void * > more;
+  for ( int i = 0; i < 16; ++i )
+    more.push_back( alloc.allocate() );
+  sites = alloc.sampled_sites();
+  ASSERT_EQ( sites.size(), 1u );
+  EXPECT_EQ( sites[0].sampled_blocks, 4u );
+  EXPECT_EQ( sites[0].estimated_blocks, 16u );
+
+  for ( void * p : more )
+    alloc.deallocate( p );
+  alloc.deallocate( ptrs[4] );
+  alloc.deallocate( ptrs[5] );
+  alloc.deallocate( other );
+  EXPECT_TRUE( alloc.sampled_sites().empty() );
+}
+
+TEST( BlockAllocator, LeakReportAtDestruction ) {
+  mem::BlockAllocatorOptions options;
+  options.leak_policy = mem::LeakPolicy::Report;
+
+  testing::internal::CaptureStderr();
+  {
+    BlockAllocator alloc( 32, 200, 32, options );
+    alloc.set_sample_interval( 1 );
+    std::vector< void * > ptrs;
+    for ( int i = 0; i < 130; ++i )
+      ptrs.push_back( alloc.allocate() );
+    for ( std::size_t i = 0; i < ptrs.size(); i += 2 )
+      alloc.deallocate( ptrs[i] );
+    alloc.deallocate_async( ptrs[1] ); // drained, not leaked
+    EXPECT_EQ( alloc.allocated_blocks(), 65u );
+    EXPECT_EQ( alloc.allocated_indices( 3 ), ( std::vector< std::size_t >{ 1, 3, 5 } ) );
+  }
+  const std::string report = testing::internal::GetCapturedStderr();
+  EXPECT_NE( report.find( "64 block(s) of 32 bytes still allocated" ), std::string::npos );
+  EXPECT_NE( report.find( "indices: 3 5 7" ), std::string::npos );
+  EXPECT_NE( report.find( "sampled live blocks" ), std::string::npos );
+
+  // Clean pools and the default policy stay silent
+  testing::internal::CaptureStderr();
+  {
+    BlockAllocator clean( 32, 4, 32, options );
+    clean.deallocate( clean.allocate() );
+    BlockAllocator quiet( 32, 4, 32 );
+    quiet.allocate();
+  }
+  EXPECT_EQ( testing::internal::GetCapturedStderr(), "" );
+}
+
+#ifndef NDEBUG
+
+TEST( BlockAllocatorDeathTest, LeakAbortsInDebug ) {
+  EXPECT_DEATH(
+      {
+        BlockAllocator alloc( 32, 4, 32 );
+        alloc.set_leak_policy( mem::LeakPolicy::AbortInDebug );
+        alloc.allocate();
+      },
+      "1 block\\(s\\) of 32 bytes still allocated" );
+}
+#endif
+
+TEST( BlockAllocator, AgeTrackingFindsLongLivedBlocks ) {
+  BlockAllocator alloc( 32, 64, 32 );
+  EXPECT_TRUE( alloc.oldest_blocks( 4 ).empty() );
+
+  alloc.set_age_tracking( true );
+  void * pinned = alloc.allocate();
+  for ( int i = 0; i < 100; ++i )
+    alloc.advance_epoch();
+  void * middle = alloc.allocate();
+  for ( int i = 0; i < 3; ++i )
+    alloc.advance_epoch();
+  void * fresh = alloc.allocate();
+
+  const auto oldest = alloc.oldest_blocks( 2 );
+  ASSERT_EQ( oldest.size(), 2u );
+  EXPECT_EQ( oldest[0].index, alloc.index_of( pinned ) );
+  EXPECT_EQ( oldest[0].age, 103u );
+  EXPECT_EQ( oldest[1].index, alloc.index_of( middle ) );
+  EXPECT_EQ( oldest[1].age, 3u );
+
+  const auto histogram = alloc.age_histogram();
+  EXPECT_EQ( histogram[0], 1u ); // fresh
+  EXPECT_EQ( histogram[2], 1u ); // 3 ticks
+  EXPECT_EQ( histogram[7], 1u ); // 103 ticks in [64, 128)
+
+  // Reallocated blocks start a new life
+  alloc.deallocate( pinned );
+  void * again = alloc.allocate();
+  EXPECT_EQ( alloc.oldest_blocks( 1 )[0].index, alloc.index_of( middle ) );
+
+  alloc.set_age_tracking( false );
+  EXPECT_EQ( alloc.age_histogram()[0], 0u );
+  alloc.deallocate( again );
+  alloc.deallocate( middle );
+  alloc.deallocate( fresh );
+}
+
+TEST( BlockAllocator, LifetimeHintsKeepPagesReleasable ) {
+  // One long-lived block per eight allocations; with hints the short-lived churn leaves whole pages free
+  auto churn = []( bool hinted ) {
+    BlockAllocator        alloc( 256, 2048, 64 );
+    std::vector< void * > short_lived, long_lived;
+    for ( int i = 0; i < 1024; ++i ) {
+      if ( i % 8 == 0 )
+        long_lived.push_back( hinted ? alloc.allocate( mem::Lifetime::Long ) : alloc.allocate() );
+      else
+        short_lived.push_back( hinted ? alloc.allocate( mem::Lifetime::Short ) : alloc.allocate() );
+    }
+    for ( void * p : short_lived )
+      alloc.deallocate( p );
+    const std::size_t released = alloc.release_free_pages();
+
+    // Long-lived blocks stay intact and are recycled on their own side
+    for ( void * p : long_lived )
+      EXPECT_TRUE( alloc.is_allocated( alloc.index_of( p ) ) );
+    if ( hinted ) {
+      void * recycled = long_lived.back();
+      alloc.deallocate( recycled );
+      EXPECT_EQ( alloc.allocate( mem::Lifetime::Long ), recycled );
+    }
+    for ( void * p : long_lived )
+      alloc.deallocate( p );
+    EXPECT_EQ( alloc.free_blocks(), alloc.block_count() );
+    return released;
+  };
+
+  const std::size_t mixed     = churn( false );
+  const std::size_t separated = churn( true );
+  EXPECT_EQ( mixed, 0u );
+  EXPECT_GE( separated, 128u * 1024u );
+}
+
+TEST( PagePool, DonatedSlabsMoveBetweenSizeClasses ) {
+  mem::PagePool              pages( 64 * 1024 );
+  mem::BlockAllocatorOptions options;
+  options.page_pool      = &pages;
+  options.reserve_blocks = 1024;
+  BlockAllocator small( 256, 256, 64, options ); // 64 KiB committed, grows to 256 KiB
+  BlockAllocator large( 4096, 16, 64, options ); // 64 KiB committed, grows to 4 MiB
+
+  std::vector< void * > blocks;
+  for ( int i = 0; i < 1024; ++i ) {
+    blocks.push_back( small.allocate() );
+    std::memset( blocks.back(), 0x5a, 256 );
+  }
+  EXPECT_EQ( small.block_count(), 1024u );
+  for ( std::size_t i = 1; i < blocks.size(); ++i )
+    small.deallocate( blocks[i] );
+
+  // Everything past the first block is free: three whole slabs can go
+  EXPECT_EQ( small.donate_free_slabs( 2 ), 2u );
+  EXPECT_EQ( small.donate_free_slabs(), 1u );
+  EXPECT_EQ( small.donate_free_slabs(), 0u );
+  EXPECT_EQ( small.block_count(), 256u );
+  EXPECT_EQ( small.free_blocks(), 255u );
+  EXPECT_EQ( pages.held_slabs(), 3u );
+  EXPECT_EQ( pages.held_bytes(), 3u * 64 * 1024 );
+
+  // The other size class grows into the donated pages and still hands out zeroed blocks on request
+  std::vector< void * > big;
+  for ( int i = 0; i < 16; ++i )
+    big.push_back( large.allocate() );
+  void * zeroed = large.allocate_zeroed();
+  EXPECT_EQ( large.block_count(), 32u );
+  EXPECT_EQ( pages.held_slabs(), 2u );
+  const auto * bytes = static_cast< const unsigned char * >( zeroed );
+  EXPECT_TRUE( std::all_of( bytes, bytes + 4096, []( unsigned char c ) { return c == 0; } ) );
+  std::memset( zeroed, 0x11, 4096 );
+
+  // The donor grows back into fresh pages and keeps its live block
+  std::vector< void * > again;
+  for ( int i = 0; i < 1023; ++i )
+    again.push_back( small.allocate_zeroed() );
+  EXPECT_EQ( small.block_count(), 1024u );
+  EXPECT_EQ( pages.held_slabs(), 0u );
+  EXPECT_EQ( static_cast< const unsigned char * >( blocks[0] )[255], 0x5a );
+  for ( void * p : again ) {
+    const auto * b = static_cast< const unsigned char * >( p );
+    ASSERT_TRUE( std::all_of( b, b + 256, []( unsigned char c ) { return c == 0; } ) );
+  }
+
+  EXPECT_EQ( pages.trim(), 0u );
+  EXPECT_THROW( mem::PagePool( 1000 ), std::invalid_argument );
+
+  for ( void * p : again )
+    small.deallocate( p );
+  small.deallocate( blocks[0] );
+  for ( void * p : big )
+    large.deallocate( p );
+  large.deallocate( zeroed );
+}
+
+TEST( MemoryBudget, PoolsChargeCommittedPagesAndReclaimFromEachOther ) {
+  const auto        page = static_cast< std::size_t >( sysconf( _SC_PAGESIZE ) );
+  mem::MemoryBudget budget( 16 * page, 12 * page );
+  EXPECT_THROW( mem::MemoryBudget( 4, 8 ), std::invalid_argument );
+
+  mem::BlockAllocatorOptions options;
+  options.budget         = &budget;
+  options.reserve_blocks = 16;
+  auto a                 = std::make_unique< BlockAllocator >( page, 4, page, options ); // one page per block
+  BlockAllocator b( page, 4, page, options );
+  EXPECT_EQ( budget.used(), 8 * page );
+
+  // b has been busy but is idle now: its pages are committed yet free
+  std::vector< void * > blocks( 4 );
+  ASSERT_TRUE( b.allocate_all( blocks.data(), blocks.size() ) );
+  b.deallocate_batch( blocks.data(), blocks.size() );
+
+  // a grows freely up to the soft limit, then by taking b's free pages, then stops at the hard limit
+  std::vector< void * > held;
+  try {
+    for ( ;; )
+      held.push_back( a->allocate() );
+  } catch ( const std::bad_alloc & ) {
+  }
+  EXPECT_EQ( held.size(), 16u );
+  EXPECT_EQ( b.block_count(), 0u );
+  EXPECT_EQ( budget.used(), 16 * page );
+  EXPECT_EQ( budget.used(), a->capacity_bytes() + b.capacity_bytes() );
+  EXPECT_THROW( BlockAllocator( page, 1, page, options ), std::bad_alloc );
+
+  // Other layers can take part; a pass never calls the requester's own callback
+  std::size_t asked = 0;
+  const auto  id    = budget.add_reclaimer( [&]( std::size_t bytes ) {
+    asked += bytes;
+    return std::size_t{ 0 };
+  } );
+  EXPECT_EQ( budget.reclaim( page, id ), 0u );
+  EXPECT_EQ( asked, 0u );
+  a->deallocate( held.back() );
+  held.pop_back();
+  EXPECT_EQ( budget.reclaim( 2 * page ), page );
+  EXPECT_GT( asked, 0u );
+  budget.remove_reclaimer( id );
+
+  // Shrunk pools grow back within the budget, and destruction returns everything
+  void * p = b.allocate();
+  EXPECT_EQ( budget.used(), 16 * page );
+  b.deallocate( p );
+  for ( void * q : held )
+    a->deallocate( q );
+  a.reset();
+  EXPECT_EQ( budget.used(), b.capacity_bytes() );
+
+  // A pool that does not fit asks the other parties only for its shortfall over the hard limit
+  mem::MemoryBudget tight( 4 * page );
+  ASSERT_TRUE( tight.charge( 3 * page ) );
+  std::size_t requested = 0;
+  tight.add_reclaimer( [&]( std::size_t bytes ) {
+    requested = bytes;
+    tight.uncharge( bytes );
+    return bytes;
+  } );
+  mem::BlockAllocatorOptions fixed;
+  fixed.budget = &tight;
+  {
+    BlockAllocator c( page, 2, page, fixed );
+    EXPECT_EQ( requested, page );
+    EXPECT_EQ( tight.used(), 4 * page );
+  }
+}
+
+TEST( BlockAllocator, SnapshotAndRestore ) {
+  char tmpl[] = "/tmp/pool_snapshotXXXXXX";
+  close( mkstemp( tmpl ) );
+  const std::string path = tmpl;
+
+  for ( auto method : { mem::SnapshotMethod::Auto, mem::SnapshotMethod::Pause } ) {
+    BlockAllocator        alloc( 64, 8192, 64 ); // 512 KiB
+    std::vector< void * > blocks;
+    for ( int i = 0; i < 6000; ++i ) {
+      blocks.push_back( alloc.allocate() );
+      std::memset( blocks.back(), i & 0xff, 64 );
+    }
+    for ( std::size_t i = 0; i < blocks.size(); i += 3 )
+      alloc.deallocate( blocks[i] );
+
+#if !defined( __SANITIZE_THREAD__ ) // the kernel orders the writer against the copy; the race detector cannot see that
+    // A writer keeps updating a block near the end of the region while the snapshot streams
+    std::atomic< bool > done{ false };
+    auto *              counter = static_cast< volatile std::uint64_t * >( blocks.back() );
+    *counter                    = 0;
+    std::thread writer( [&] {
+      while ( !done.load( std::memory_order_relaxed ) )
+        *counter = *counter + 1;
+    } );
+    const mem::SnapshotStats stats = alloc.snapshot( path, method );
+    done.store( true );
+    writer.join();
+#else
+    auto * counter = static_cast< volatile std::uint64_t * >( blocks.back() );
+    *counter       = 0;
+    const mem::SnapshotStats stats = alloc.snapshot( path, method );
+#endif
+    if ( method == mem::SnapshotMethod::Pause ) {
+      EXPECT_EQ( stats.method, mem::SnapshotMethod::Pause );
+      EXPECT_EQ( stats.pages_copied_early, 0u );
+    }
+    EXPECT_GT( stats.bytes_written, 8192u * 64 );
+
+    auto restored = BlockAllocator::restore( path );
+    ASSERT_EQ( restored->block_count(), alloc.block_count() );
+    EXPECT_EQ( restored->stride(), alloc.stride() );
+    EXPECT_EQ( restored->free_blocks(), alloc.free_blocks() );
+    EXPECT_EQ( restored->allocated_indices(), alloc.allocated_indices() );
+    for ( std::size_t i = 1; i + 1 < blocks.size(); ++i ) {
+      if ( i % 3 == 0 )
+        continue;
+      const auto * b = static_cast< const unsigned char * >( restored->block_at( i ) );
+      ASSERT_EQ( b[0], i & 0xff );
+      ASSERT_EQ( b[63], i & 0xff );
+    }
+    EXPECT_LE( *static_cast< const std::uint64_t * >( restored->block_at( blocks.size() - 1 ) ), *counter );
+
+    // Free blocks come back lowest address first
+    EXPECT_EQ( restored->index_of( restored->allocate() ), 0u );
+
+    for ( std::size_t i = 0; i < blocks.size(); ++i )
+      if ( i % 3 != 0 )
+        alloc.deallocate( blocks[i] );
+  }
+
+  // Competing snapshots to one path: each writes its own temporary file, so the survivor is whole
+  {
+    BlockAllocator        alloc( 4096, 512, 64 ); // 2 MiB
+    std::vector< void * > blocks( 512 );
+    ASSERT_TRUE( alloc.allocate_all( blocks.data(), blocks.size() ) );
+    for ( std::size_t i = 0; i < blocks.size(); ++i )
+      std::memset( blocks[i], static_cast< int >( i & 0xff ), 4096 );
+    auto take = [&] {
+      for ( int round = 0; round < 4; ++round ) {
+        try {
+          alloc.snapshot( path );
+        } catch ( const std::logic_error & ) {
+          // the other thread's write-protected snapshot is running
+        }
+      }
+    };
+    std::thread other( take );
+    take();
+    other.join();
+    auto restored = BlockAllocator::restore( path );
+    for ( std::size_t i = 0; i < blocks.size(); ++i )
+      ASSERT_EQ( static_cast< const unsigned char * >( restored->block_at( i ) )[4095], i & 0xff );
+    EXPECT_FALSE( std::ifstream( path + ".tmp." + std::to_string( getpid() ) + ".0" ).good() );
+    alloc.deallocate_batch( blocks.data(), blocks.size() );
+  }
+
+  EXPECT_THROW( BlockAllocator::restore( path + ".missing" ), std::runtime_error );
+  std::ofstream( path ) << "not a snapshot";
+  EXPECT_THROW( BlockAllocator::restore( path ), std::runtime_error );
+  std::remove( path.c_str() );
+}
+
+TEST( BlockAllocator, LazyRestoreFillsPagesOnDemand ) {
+  int uffd = -1;
+#ifdef UFFD_USER_MODE_ONLY
+  uffd = static_cast< int >( syscall( SYS_userfaultfd, O_CLOEXEC | UFFD_USER_MODE_ONLY ) );
+#endif
+  if ( uffd < 0 )
+    uffd = static_cast< int >( syscall( SYS_userfaultfd, O_CLOEXEC ) );
+  if ( uffd < 0 )
+    GTEST_SKIP() << "userfaultfd is not available; lazy restore falls back to an eager copy";
+  close( uffd );
+
+  char tmpl[] = "/tmp/pool_snapshotXXXXXX";
+  close( mkstemp( tmpl ) );
+  const std::string path = tmpl;
+
+  // Large enough that the prefetcher is still running when restore() returns
+  constexpr std::size_t kBlocks = std::size_t{ 1 } << 20;
+  BlockAllocator        alloc( 48, kBlocks, 16 ); // stride 48: blocks straddle pages
+  for ( std::size_t i = 0; i < kBlocks; ++i )
+    std::memset( alloc.allocate(), static_cast< int >( i & 0xff ), 48 );
+  for ( std::size_t i = 0; i < kBlocks; i += 2 )
+    alloc.deallocate( alloc.block_at( i ) );
+  alloc.snapshot( path, mem::SnapshotMethod::Pause );
+
+  auto              restored = BlockAllocator::restore( path, {}, mem::RestoreMode::Lazy );
+  const std::size_t pending  = restored->restore_pages_pending();
+  EXPECT_GT( pending, 0u );
+  EXPECT_EQ( restored->free_blocks(), alloc.free_blocks() );
+  EXPECT_EQ( restored->allocated_indices(), alloc.allocated_indices() );
+
+  // Touch the far end first: served on demand, ahead of the prefetcher
+  for ( std::size_t i = kBlocks - 1; i > kBlocks - 20000; i -= 2 ) {
+    const auto * b = static_cast< const unsigned char * >( restored->block_at( i ) );
+    ASSERT_EQ( b[0], i & 0xff );
+    ASSERT_EQ( b[47], i & 0xff );
+  }
+  EXPECT_LT( restored->restore_pages_pending(), pending );
+  // Free blocks read as zero even though their old contents are in the file
+  const auto * z = static_cast< const unsigned char * >( restored->allocate_zeroed() );
+  EXPECT_EQ( restored->index_of( z ), 0u );
+  for ( std::size_t i = 0; i < 48; ++i )
+    ASSERT_EQ( z[i], 0 );
+
+  for ( int i = 0; i < 10000 && restored->restore_pages_pending() != 0; ++i )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  EXPECT_EQ( restored->restore_pages_pending(), 0u );
+  for ( std::size_t i = 1; i < kBlocks; i += 2 )
+    ASSERT_EQ( static_cast< const unsigned char * >( restored->block_at( i ) )[0], i & 0xff );
+  std::remove( path.c_str() );
+}
+
+TEST( BlockAllocator, DeallocateAllByTag ) {
+  BlockAllocator alloc( 32, 1003, 8 ); // not a multiple of the SIMD width
+  const mem::BlockTag a{ 7 }, b{ 0xfffe };
+  std::vector< void * > untagged;
+  for ( int i = 0; i < 1003; ++i ) {
+    if ( i % 3 == 0 )
+      alloc.allocate( a );
+    else if ( i % 3 == 1 )
+      alloc.allocate( b );
+    else
+      untagged.push_back( alloc.allocate() );
+  }
+  EXPECT_EQ( alloc.tag_of( 0 ), a );
+  EXPECT_EQ( alloc.tag_of( 1002 ), a );
+  EXPECT_EQ( alloc.tag_of( 2 ), mem::BlockTag::None );
+
+  EXPECT_EQ( alloc.deallocate_all( a ), 335u );
+  EXPECT_EQ( alloc.free_blocks(), 335u );
+  EXPECT_EQ( alloc.tag_of( 0 ), mem::BlockTag::None );
+  EXPECT_EQ( alloc.deallocate_all( a ), 0u );
+  EXPECT_EQ( alloc.deallocate_all( mem::BlockTag::None ), 0u );
+
+  // Freed blocks come back untagged and lowest address first
+  void * p = alloc.allocate();
+  EXPECT_EQ( alloc.index_of( p ), 0u );
+  EXPECT_EQ( alloc.deallocate_all( b ), 334u );
+  EXPECT_TRUE( alloc.is_allocated( 0 ) );
+  alloc.deallocate( p );
+  alloc.deallocate_batch( untagged.data(), untagged.size() );
+  EXPECT_EQ( alloc.free_blocks(), 1003u );
+
+  // A block queued by deallocate_async() is left to the drain, even if reallocated meanwhile
+  void * queued = alloc.allocate( a );
+  void * kept   = alloc.allocate( a );
+  alloc.deallocate_async( queued );
+  EXPECT_EQ( alloc.deallocate_all( a ), 1u );
+  EXPECT_FALSE( alloc.is_allocated( alloc.index_of( kept ) ) );
+  EXPECT_EQ( alloc.drain(), 1u );
+  EXPECT_EQ( alloc.free_blocks(), 1003u );
+  void * again = alloc.allocate( a );
+  alloc.deallocate_async( again );
+  EXPECT_EQ( alloc.deallocate_all( a ), 0u );
+  void * other = alloc.allocate( b ); // the drain must not free this one
+  EXPECT_NO_THROW( alloc.drain() );
+  EXPECT_EQ( alloc.free_blocks(), 1002u );
+  alloc.deallocate( other );
+}
+
+TEST( SegmentedVector, StableAddressesAndBulkOps ) {
+  mem::SegmentedVector< std::string > v( 10000, 100 ); // rounded down to 64 per segment
+  EXPECT_EQ( v.segment_size(), 64u );
+  v.push_back( "first" );
+  const std::string * first = &v[0];
+  for ( int i = 1; i < 1000; ++i )
+    v.emplace_back( std::to_string( i ) );
+  EXPECT_EQ( &v[0], first ); // growth never moves elements
+  EXPECT_EQ( v[999], "999" );
+  EXPECT_EQ( v.capacity(), 1024u );
+
+  const std::vector< std::string > more( 500, "x" );
+  v.append( more.begin(), more.end() );
+  v.append( 3, "y" );
+  EXPECT_EQ( v.size(), 1503u );
+  EXPECT_EQ( v.at( 1499 ), "x" );
+  EXPECT_EQ( v.back(), "y" );
+  EXPECT_THROW( v.at( 1503 ), std::out_of_range );
+
+  v.pop_back();
+  EXPECT_EQ( v.size(), 1502u );
+  v.clear();
+  EXPECT_TRUE( v.empty() );
+  EXPECT_EQ( v.capacity(), 0u );
+  v.append( 10000, "z" );
+  EXPECT_THROW( v.push_back( "over" ), std::length_error );
+  EXPECT_THROW( mem::SegmentedVector< int >( 0 ), std::invalid_argument );
+}
+
+TEST( ClockCache, EvictsUnusedEntriesIntoTheirBlocks ) {
+  mem::ClockCache< int, std::string > cache( 4 );
+  for ( int k = 0; k < 4; ++k )
+    cache.put( k, std::to_string( k ) );
+  EXPECT_EQ( cache.size(), 4u );
+  ASSERT_NE( cache.find( 0 ), nullptr );
+  ASSERT_NE( cache.find( 2 ), nullptr );
+  const std::string * victim_slot = cache.find( 1 );
+  cache.find( 3 );
+  cache.find( 1 ); // every entry used: the hand clears all bits, then takes block 0
+  const std::string * first_slot = cache.find( 0 );
+  cache.put( 4, "four" );
+  EXPECT_FALSE( cache.contains( 0 ) );
+  EXPECT_EQ( cache.find( 4 ), first_slot ); // new entry built in the victim's block
+  EXPECT_EQ( cache.evictions(), 1u );
+
+  // 1 was used again since the sweep; 2 and 3 were not, so 1 survives
+  cache.find( 1 );
+  cache.put( 5, "five" );
+  cache.put( 6, "six" );
+  EXPECT_TRUE( cache.contains( 1 ) );
+  EXPECT_EQ( cache.find( 1 ), victim_slot );
+  EXPECT_FALSE( cache.contains( 2 ) );
+  EXPECT_FALSE( cache.contains( 3 ) );
+  EXPECT_EQ( *cache.find( 6 ), "six" );
+
+  cache.put( 6, "SIX" );
+  EXPECT_EQ( *cache.find( 6 ), "SIX" );
+  EXPECT_EQ( cache.size(), 4u );
+  EXPECT_TRUE( cache.erase( 5 ) );
+  EXPECT_FALSE( cache.erase( 5 ) );
+  cache.put( 7, "seven" ); // fills the erased block, no eviction
+  EXPECT_EQ( cache.evictions(), 3u );
+
+  // Index stays consistent under churn with colliding probe runs
+  mem::ClockCache< int, int > big( 100 );
+  for ( int k = 0; k < 10000; ++k ) {
+    if ( k % 7 == 0 )
+      big.erase( ( k * 13 ) % 317 );
+    big.put( k % 317, k );
+    const int * v = big.find( k % 317 );
+    ASSERT_NE( v, nullptr );
+    ASSERT_EQ( *v, k );
+  }
+  std::size_t found = 0;
+  for ( int key = 0; key < 317; ++key ) {
+    if ( const int * v = big.find( key ) ) {
+      EXPECT_EQ( *v % 317, key );
+      ++found;
+    }
+  }
+  EXPECT_EQ( found, big.size() );
+  EXPECT_LE( big.size(), 100u );
+  big.clear();
+  EXPECT_TRUE( big.empty() );
+}
+
+namespace {
+mem::SignalSafePool * profiler_pool   = nullptr;
+volatile sig_atomic_t profiler_ticks  = 0;
+volatile sig_atomic_t profiler_errors = 0;
+
+void on_sigprof( int ) {
+  // What a sampling profiler does: grab a few records, fill them, hand them back
+  void * held[4];
+  for ( void *& p : held ) {
+    p = profiler_pool->allocate();
+    if ( p )
+      std::memset( p, 0x5a, profiler_pool->block_size() );
+  }
+  for ( void * p : held ) {
+    if ( !profiler_pool->deallocate( p ) )
+      profiler_errors = profiler_errors + 1;
+  }
+  profiler_ticks = profiler_ticks + 1;
+}
+} // namespace
+
+TEST( SignalSafePool, AllocatesFromSigprofHandlerWhileMainThreadAllocates ) {
+  mem::SignalSafePool pool( 48, 64, 16 );
+  EXPECT_EQ( pool.stride(), 48u );
+  void * p = pool.allocate();
+  EXPECT_TRUE( pool.owns( p ) );
+  EXPECT_TRUE( pool.deallocate( p ) );
+  EXPECT_FALSE( pool.deallocate( p ) ); // double free
+  int local = 0;
+  EXPECT_FALSE( pool.deallocate( &local ) );
+  EXPECT_FALSE( pool.deallocate( static_cast< char * >( pool.allocate() ) + 1 ) );
+  EXPECT_THROW( mem::SignalSafePool( 8, 8, 3 ), std::invalid_argument );
+
+  mem::SignalSafePool shared( 64, 32 );
+  profiler_pool = &shared;
+  struct sigaction action{}, previous{};
+  action.sa_handler = on_sigprof;
+  sigemptyset( &action.sa_mask );
+  ASSERT_EQ( sigaction( SIGPROF, &action, &previous ), 0 );
+  itimerval timer{ { 0, 200 }, { 0, 200 } }, previous_timer{};
+  ASSERT_EQ( setitimer( ITIMER_PROF, &timer, &previous_timer ), 0 );
+
+  // The main thread churns the same pool, so handlers land in the middle of its CAS loops
+  std::size_t exhausted = 0, bad_frees = 0;
+  const auto  deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( 300 );
+  while ( std::chrono::steady_clock::now() < deadline || profiler_ticks < 20 ) {
+    void * held[16];
+    for ( void *& q : held ) {
+      q = shared.allocate();
+      exhausted += q == nullptr;
+    }
+    for ( void * q : held )
+      bad_frees += !shared.deallocate( q );
+  }
+
+  itimerval off{};
+  setitimer( ITIMER_PROF, &off, nullptr );
+  sigaction( SIGPROF, &previous, nullptr );
+  setitimer( ITIMER_PROF, &previous_timer, nullptr );
+  profiler_pool = nullptr;
+
+  EXPECT_GE( profiler_ticks, 20 );
+  EXPECT_EQ( profiler_errors, 0 );
+  EXPECT_EQ( exhausted, 0u ); // 16 + 4 blocks in use at most
+  EXPECT_EQ( bad_frees, 0u );
+  EXPECT_EQ( shared.free_blocks(), 32u );
+}
+
+TEST( BlockAllocator, CollectDirtyReturnsMarkedBlocksOnce ) {
+  BlockAllocator        alloc( 32, 1000, 8 );
+  std::vector< void * > blocks;
+  for ( int i = 0; i < 1000; ++i )
+    blocks.push_back( alloc.allocate() );
+  EXPECT_TRUE( alloc.collect_dirty().empty() );
+
+  alloc.mark_dirty( blocks[900] );
+  alloc.mark_dirty( blocks[3] );
+  alloc.mark_dirty( blocks[3] );
+  alloc.mark_dirty( blocks[64] );
+  EXPECT_EQ( alloc.collect_dirty(), ( std::vector< std::size_t >{ 3, 64, 900 } ) );
+  EXPECT_TRUE( alloc.collect_dirty().empty() );
+  int local = 0;
+  EXPECT_THROW( alloc.mark_dirty( &local ), std::runtime_error );
+  EXPECT_THROW( alloc.mark_dirty( static_cast< char * >( blocks[0] ) + 1 ), std::runtime_error );
+
+  // Writers mark concurrently with a collector; every mark lands in exactly one collection
+  std::vector< std::size_t > seen( 1000, 0 );
+  std::atomic< bool >        done{ false };
+  std::vector< std::thread > writers;
+  for ( int t = 0; t < 4; ++t ) {
+    writers.emplace_back( [&, t] {
+      for ( int i = t; i < 1000; i += 4 )
+        alloc.mark_dirty( blocks[static_cast< std::size_t >( i )] );
+    } );
+  }
+  std::thread collector( [&] {
+    while ( !done.load() )
+      for ( std::size_t idx : alloc.collect_dirty() )
+        ++seen[idx];
+  } );
+  for ( auto & w : writers )
+    w.join();
+  done.store( true );
+  collector.join();
+  for ( std::size_t idx : alloc.collect_dirty() )
+    ++seen[idx];
+  EXPECT_EQ( std::count( seen.begin(), seen.end(), 1u ), 1000 );
+
+  for ( void * p : blocks )
+    alloc.deallocate( p );
+}
+
+TEST( SizeClassHeap, PagesMoveBetweenClassesThroughTheFreePageStack ) {
+  mem::SizeClassHeap heap( 4 * 64 * 1024, { 24, 100, 4096 } );
+  EXPECT_EQ( heap.page_count(), 4u );
+  EXPECT_EQ( heap.class_size( 0 ), 32u ); // rounded to 16
+  EXPECT_THROW( heap.allocate( 4097 ), std::bad_alloc );
+  EXPECT_THROW( mem::SizeClassHeap( 64 * 1024, { 64, 32 } ), std::invalid_argument );
+
+  // Fill three pages with 32-byte blocks
+  std::vector< void * > small( 3 * 2048 );
+  for ( void *& p : small ) {
+    p = heap.allocate( 20 );
+    EXPECT_EQ( reinterpret_cast< std::uintptr_t >( p ) % 16, 0u );
+  }
+  EXPECT_EQ( heap.class_pages( 0 ), 3u );
+  EXPECT_EQ( heap.free_pages(), 1u );
+  EXPECT_EQ( heap.block_size_of( small[5] ), 32u );
+
+  // The last page goes to 4 KiB blocks; then the region is exhausted for that class
+  std::vector< void * > large;
+  for ( int i = 0; i < 16; ++i )
+    large.push_back( heap.allocate( 4096 ) );
+  EXPECT_EQ( heap.free_pages(), 0u );
+  EXPECT_THROW( heap.allocate( 4000 ), std::bad_alloc );
+
+  // Emptying one small page hands it to the large class
+  for ( std::size_t i = 0; i < 2048; ++i )
+    heap.deallocate( small[i] );
+  EXPECT_EQ( heap.class_pages( 0 ), 2u );
+  EXPECT_EQ( heap.free_pages(), 1u );
+  EXPECT_THROW( heap.deallocate( small[0] ), std::runtime_error ); // its page is free now
+  EXPECT_THROW( heap.deallocate( static_cast< char * >( small[2048] ) + 16 ), std::runtime_error );
+  large.push_back( heap.allocate( 3000 ) );
+  EXPECT_EQ( heap.class_pages( 2 ), 2u );
+
+  // A freed block is reused by its own page; a double free is caught
+  heap.deallocate( small[3000] );
+  EXPECT_THROW( heap.deallocate( small[3000] ), std::runtime_error );
+  EXPECT_EQ( heap.allocate( 32 ), small[3000] );
+
+  for ( std::size_t i = 2048; i < small.size(); ++i )
+    heap.deallocate( small[i] );
+  for ( void * p : large )
+    heap.deallocate( p );
+  EXPECT_EQ( heap.free_pages(), 4u );
+  EXPECT_EQ( heap.trim(), 4u * 64 * 1024 );
+  EXPECT_EQ( heap.trim(), 0u );
+  EXPECT_NE( heap.allocate( 100 ), nullptr );
+}
+
+TEST( PageMap, DeallocateFindsTheOwningPool ) {
+  std::vector< void * > blocks;
+  void *                stale = nullptr;
+  {
+    BlockAllocator             small( 32, 100, 32 );
+    mem::BlockAllocatorOptions options;
+    options.reserve_blocks = 4096;
+    BlockAllocator large( 8192, 2, 64, options ); // growable: pages are registered as they are committed
+    auto * const   frontier = static_cast< char * >( large.block_at( 0 ) ) + 64 * 8192;
+    EXPECT_EQ( mem::owner_of( frontier ), nullptr );
+    for ( int i = 0; i < 50; ++i ) {
+      blocks.push_back( small.allocate() );
+      blocks.push_back( large.allocate() );
+    }
+    EXPECT_EQ( mem::owner_of( frontier - 1 ), &large ); // grown to 64 blocks
+    EXPECT_EQ( mem::owner_of( frontier ), nullptr );
+    EXPECT_EQ( mem::owner_of( blocks[0] ), &small );
+    EXPECT_EQ( mem::owner_of( blocks[1] ), &large );
+    EXPECT_EQ( mem::owner_of( static_cast< char * >( blocks[0] ) + 7 ), &small );
+
+    // Free in mixed order without naming the pool
+    std::shuffle( blocks.begin(), blocks.end(), std::mt19937{ 7 } );
+    for ( void * p : blocks )
+      mem::deallocate( p );
+    EXPECT_EQ( small.allocated_blocks(), 0u );
+    EXPECT_EQ( large.allocated_blocks(), 0u );
+
+    int local = 0;
+    EXPECT_EQ( mem::owner_of( &local ), nullptr );
+    EXPECT_THROW( mem::deallocate( &local ), std::runtime_error );
+    EXPECT_THROW( mem::deallocate( blocks[0] ), std::runtime_error ); // double free, reported by the pool
+    EXPECT_NO_THROW( mem::deallocate( nullptr ) );
+    large.decommit_free_tail();
+    EXPECT_EQ( mem::owner_of( large.block_at( 0 ) ), nullptr );
+    stale = small.allocate();
+  }
+  EXPECT_EQ( mem::owner_of( stale ), nullptr ); // unregistered on destruction
+}
+
+TEST( BlockAllocator, ExhaustionHandlersReclaimBeforeFailing ) {
+  mem::BlockAllocatorOptions options;
+  options.exhaustion_retries = 2;
+  BlockAllocator        alloc( 64, 4, 64, options );
+  std::vector< void * > cache; // blocks a cache could give back
+
+  std::size_t calls = 0, reentrant_failures = 0;
+  const auto  evict = alloc.add_exhaustion_handler( [&]( BlockAllocator & pool, std::size_t blocks ) {
+    ++calls;
+    EXPECT_EQ( &pool, &alloc );
+    try {
+      pool.allocate(); // runs dry again without re-entering the chain
+    } catch ( const std::bad_alloc & ) {
+      ++reentrant_failures;
+    }
+    for ( ; blocks > 0 && !cache.empty(); --blocks ) {
+      pool.deallocate( cache.back() );
+      cache.pop_back();
+    }
+    return blocks == 0;
+  } );
+
+  for ( int i = 0; i < 4; ++i )
+    cache.push_back( alloc.allocate() );
+  void * p = alloc.allocate(); // the handler evicts one cached block
+  EXPECT_EQ( calls, 1u );
+  EXPECT_EQ( reentrant_failures, 1u );
+  EXPECT_EQ( cache.size(), 3u );
+
+  void * batch[3];
+  EXPECT_TRUE( alloc.allocate_all( batch, 3 ) );
+  EXPECT_TRUE( cache.empty() );
+  EXPECT_EQ( calls, 2u );
+
+  // Nothing left to evict: one pass without progress, then bad_alloc
+  EXPECT_THROW( alloc.allocate(), std::bad_alloc );
+  EXPECT_EQ( calls, 3u );
+
+  // A handler that always claims progress is bounded by exhaustion_retries
+  std::size_t optimistic = 0;
+  const auto  id         = alloc.add_exhaustion_handler( [&]( BlockAllocator &, std::size_t ) { return ++optimistic > 0; } );
+  EXPECT_THROW( alloc.allocate_zeroed(), std::bad_alloc );
+  EXPECT_EQ( optimistic, 2u );
+
+  alloc.remove_exhaustion_handler( id );
+  alloc.remove_exhaustion_handler( evict );
+  calls = 0;
+  EXPECT_THROW( alloc.allocate(), std::bad_alloc );
+  EXPECT_EQ( calls, 0u );
+
+  alloc.deallocate( p );
+  for ( void * q : batch )
+    alloc.deallocate( q );
+}